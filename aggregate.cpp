@@ -0,0 +1,290 @@
+#include "aggregate.hpp"
+#include "feedparser.hpp"
+#include "records.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <libxml/parser.h>
+#include <libxml/xmlreader.h>
+#include <map>
+#include <string_view>
+
+// What the site table says about one measuredValue index
+struct Characteristic
+{
+    bool speed = false; // trafficSpeed, else some other value type
+    PairClass pair;
+    bool lower = false; // has a lower length bound
+    bool upper = false; // has an upper length bound
+    bool anyVehicle = false;
+};
+
+// Text of the current element; empty when it has none
+static std::string readText(xmlTextReaderPtr reader)
+{
+    xmlChar* text = xmlTextReaderReadString(reader);
+    if (text == nullptr)
+    {
+        return {};
+    }
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    std::string value(reinterpret_cast<const char*>(text));
+    xmlFree(text);
+    return value;
+}
+
+static std::string readAttribute(xmlTextReaderPtr reader, const char* name)
+{
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    xmlChar* text = xmlTextReaderGetAttribute(
+        reader, reinterpret_cast<const xmlChar*>(name));
+    if (text == nullptr)
+    {
+        return {};
+    }
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    std::string value(reinterpret_cast<const char*>(text));
+    xmlFree(text);
+    return value;
+}
+
+static std::uint8_t laneNumber(std::string_view lane)
+{
+    unsigned int number = 0;
+    if (!lane.starts_with("lane") ||
+        std::from_chars(lane.data() + 4, lane.data() + lane.size(), number)
+                .ec != std::errc() ||
+        number > UINT8_MAX)
+    {
+        return 0;
+    }
+    return static_cast<std::uint8_t>(number);
+}
+
+static VehicleClass vehicleClass(const Characteristic& c)
+{
+    if (c.anyVehicle)
+    {
+        return VehicleClass::Any;
+    }
+    if (c.upper && !c.lower)
+    {
+        return VehicleClass::Short;
+    }
+    if (c.upper && c.lower)
+    {
+        return VehicleClass::Medium;
+    }
+    if (c.lower)
+    {
+        return VehicleClass::Long;
+    }
+    return VehicleClass::Unknown;
+}
+
+bool SiteLayout::load(const std::string& path)
+{
+    xmlTextReaderPtr reader =
+        xmlReaderForFile(path.c_str(), nullptr, xmlReaderOptions());
+    if (reader == nullptr)
+    {
+        return false;
+    }
+    SiteKey site = 0;
+    std::map<long, Characteristic> characteristics; // by index
+    Characteristic* current = nullptr;
+    std::string comparison;
+    int status = 0;
+    while ((status = xmlTextReaderRead(reader)) == 1)
+    {
+        const int nodeType = xmlTextReaderNodeType(reader);
+        if (nodeType != XML_READER_TYPE_ELEMENT &&
+            nodeType != XML_READER_TYPE_END_ELEMENT)
+        {
+            continue;
+        }
+        // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+        const auto* local = reinterpret_cast<const char*>(
+            xmlTextReaderConstLocalName(reader));
+        if (local == nullptr)
+        {
+            continue;
+        }
+        const std::string_view name(local);
+        if (nodeType == XML_READER_TYPE_END_ELEMENT)
+        {
+            if (name != "measurementSiteRecord" || site == 0)
+            {
+                continue;
+            }
+            // Pairs follow the speed indices in order
+            std::vector<PairClass>& pairs = sites_[site];
+            pairs.clear();
+            for (const auto& [index, c] : characteristics)
+            {
+                if (c.speed)
+                {
+                    pairs.push_back(c.pair);
+                }
+            }
+            site = 0;
+            current = nullptr;
+            characteristics.clear();
+        }
+        else if (name == "measurementSiteRecord")
+        {
+            const std::string id = readAttribute(reader, "id");
+            site = id.empty() ? 0 : recordSiteKey(id);
+        }
+        else if (name == "measurementSpecificCharacteristics")
+        {
+            // The outer element carries the index, the inner one the values
+            const std::string index = readAttribute(reader, "index");
+            if (!index.empty())
+            {
+                const int decimal = 10;
+                current = &characteristics[std::strtol(
+                    index.c_str(), nullptr, decimal)];
+            }
+        }
+        else if (current == nullptr)
+        {
+            continue;
+        }
+        else if (name == "specificLane")
+        {
+            current->pair.lane = laneNumber(readText(reader));
+        }
+        else if (name == "specificMeasurementValueType")
+        {
+            current->speed = readText(reader) == "trafficSpeed";
+        }
+        else if (name == "vehicleType")
+        {
+            current->anyVehicle = readText(reader) == "anyVehicle";
+            current->pair.vehicles = vehicleClass(*current);
+        }
+        else if (name == "comparisonOperator")
+        {
+            comparison = readText(reader);
+        }
+        else if (name == "vehicleLength")
+        {
+            if (comparison.starts_with("greaterThan"))
+            {
+                current->lower = true;
+            }
+            else if (comparison.starts_with("lessThan"))
+            {
+                current->upper = true;
+            }
+            current->pair.vehicles = vehicleClass(*current);
+        }
+    }
+    xmlFreeTextReader(reader);
+    return status == 0;
+}
+
+const std::vector<PairClass>* SiteLayout::pairs(SiteKey site) const
+{
+    const auto found = sites_.find(site);
+    return found == sites_.end() ? nullptr : &found->second;
+}
+
+constexpr std::size_t maxLanes = 16; // lane numbers above share the last
+
+void SiteAggregate::build(const RecordBatch& batch, const SiteLayout& layout)
+{
+    clear();
+    const std::size_t rows = batch.size();
+    for (std::size_t begin = 0; begin < rows;)
+    {
+        std::size_t end = begin + 1;
+        while (end < rows && batch.site[end] == batch.site[begin])
+        {
+            ++end;
+        }
+        const std::vector<PairClass>* pairs = layout.pairs(batch.site[begin]);
+
+        std::array<HarmonicSum, vehicleClasses> classes{};
+        std::array<HarmonicSum, maxLanes> laneClasses{};
+        std::array<HarmonicSum, maxLanes> laneAny{};
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            // Pair numbers start at 1; a pair the table does not describe
+            // could be a class or the anyVehicle total, so it is left out
+            const std::uint32_t pair = batch.index[i] - 1;
+            const PairClass c = pairs != nullptr && pair < pairs->size()
+                                    ? (*pairs)[pair]
+                                    : PairClass{0, VehicleClass::Unknown};
+            const std::size_t lane = std::min<std::size_t>(c.lane, maxLanes - 1);
+            switch (c.vehicles)
+            {
+            case VehicleClass::Any:
+                laneAny[lane].add(batch.speed[i], batch.flow[i]);
+                break;
+            case VehicleClass::Short:
+            case VehicleClass::Medium:
+            case VehicleClass::Long:
+            {
+                const auto slot = static_cast<std::size_t>(c.vehicles) - 1;
+                classes[slot].add(batch.speed[i], batch.flow[i]);
+                laneClasses[lane].add(batch.speed[i], batch.flow[i]);
+                break;
+            }
+            case VehicleClass::Unknown:
+                break;
+            }
+        }
+
+        HarmonicSum total;
+        for (std::size_t lane = 0; lane < maxLanes; ++lane)
+        {
+            total.add(laneClasses[lane].flow > 0 ? laneClasses[lane]
+                                                 : laneAny[lane]);
+        }
+        site.push_back(batch.site[begin]);
+        speed.push_back(total.speed());
+        flow.push_back(total.flow);
+        speedFlow.push_back(total.speedFlow);
+        std::array<double, vehicleClasses> speeds{};
+        std::array<std::int64_t, vehicleClasses> flows{};
+        for (std::size_t k = 0; k < vehicleClasses; ++k)
+        {
+            speeds[k] = classes[k].speed();
+            flows[k] = classes[k].flow;
+        }
+        classSpeed.push_back(speeds);
+        classFlow.push_back(flows);
+        begin = end;
+    }
+}
+
+void SiteAggregate::clear()
+{
+    site.clear();
+    speed.clear();
+    flow.clear();
+    speedFlow.clear();
+    classSpeed.clear();
+    classFlow.clear();
+}
+
+void SiteAggregate::write(std::ostream& out, const RecordBatch& batch) const
+{
+    for (std::size_t i = 0; i < size(); ++i)
+    {
+        std::string name = batch.siteId(site[i]);
+        if (name.empty())
+        {
+            name = "(unknown_site)";
+        }
+        out << name << ' ' << std::defaultfloat << speed[i] << ' ' << flow[i];
+        for (std::size_t k = 0; k < vehicleClasses; ++k)
+        {
+            out << ' ' << classSpeed[i][k] << ' ' << classFlow[i][k];
+        }
+        out << '\n';
+    }
+}
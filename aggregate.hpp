@@ -0,0 +1,126 @@
+#pragma once
+
+#include "sitekey.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class RecordBatch;
+
+// Per-site aggregation of the lane and vehicle-class split a site reports
+// (xmline --aggregate). The measurement site table describes every
+// measuredValue index by its measurementSpecificCharacteristics: lane,
+// value type and vehicle length class. The feed lists the flows of a site
+// first and its speeds after them in the same order, so pair k of a block
+// is the k-th trafficSpeed index of the site.
+
+enum class VehicleClass : std::uint8_t
+{
+    Any,    // anyVehicle
+    Short,  // only an upper length bound (< 5.6 m)
+    Medium, // both bounds (5.6-12.2 m)
+    Long,   // only a lower length bound (> 12.2 m)
+    Unknown
+};
+
+constexpr std::size_t vehicleClasses = 3; // Short, Medium, Long
+
+struct PairClass
+{
+    std::uint8_t lane = 0; // laneN, 0 for anything else
+    VehicleClass vehicles = VehicleClass::Any;
+};
+
+// Total flow and flow-weighted harmonic mean speed. Every flow counts
+// towards the total; the speed sums (flow and flow / speed) only take the
+// pairs that have both a speed and a flow.
+struct HarmonicSum
+{
+    std::int64_t flow = 0;
+    std::int64_t speedFlow = 0; // flow of the pairs with a speed
+    double time = 0;
+
+    void add(double speed, std::int64_t pairFlow)
+    {
+        if (pairFlow <= 0)
+        {
+            return;
+        }
+        flow += pairFlow;
+        if (speed > 0)
+        {
+            speedFlow += pairFlow;
+            time += static_cast<double>(pairFlow) / speed;
+        }
+    }
+
+    void add(const HarmonicSum& other)
+    {
+        flow += other.flow;
+        speedFlow += other.speedFlow;
+        time += other.time;
+    }
+
+    [[nodiscard]] double speed() const
+    {
+        return time > 0 ? static_cast<double>(speedFlow) / time : -1;
+    }
+};
+
+class SiteLayout
+{
+  public:
+    // Read a measurement site table; false when it cannot be parsed
+    bool load(const std::string& path);
+
+    // Classes of the pairs of site, nullptr when the table lacks it
+    [[nodiscard]] const std::vector<PairClass>* pairs(SiteKey site) const;
+
+    [[nodiscard]] std::size_t sites() const { return sites_.size(); }
+
+  private:
+    std::unordered_map<SiteKey, std::vector<PairClass>> sites_;
+};
+
+// One row per site of a publication, in columns: the flow-weighted
+// harmonic mean speed (sum of flows over the sum of flow / speed) and total
+// flow over the whole carriageway and per class. A lane's anyVehicle pair
+// counts towards the total only when the lane has no class pairs with
+// flow. Speeds are -1 when no pair had both a speed and a flow.
+class SiteAggregate
+{
+  public:
+    std::vector<SiteKey> site;
+    std::vector<double> speed;
+    std::vector<std::int64_t> flow;
+    std::vector<std::int64_t> speedFlow; // the part of flow behind speed
+    std::vector<std::array<double, vehicleClasses>> classSpeed;
+    std::vector<std::array<std::int64_t, vehicleClasses>> classFlow;
+
+    [[nodiscard]] std::size_t size() const { return site.size(); }
+
+    // Aggregate every block of batch, whose blocks must be contiguous;
+    // sites missing from layout get a row with speed -1 and flow 0, which
+    // rollups and segments pass over
+    void build(const RecordBatch& batch, const SiteLayout& layout);
+
+    void clear();
+
+    // Sums of a row, to be added up over sites
+    [[nodiscard]] HarmonicSum sum(std::size_t row) const
+    {
+        return {flow[row],
+                speedFlow[row],
+                speed[row] > 0
+                    ? static_cast<double>(speedFlow[row]) / speed[row]
+                    : 0};
+    }
+
+    // Text lines: site speed flow, then speed and flow per class
+    void write(std::ostream& out, const RecordBatch& batch) const;
+};
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <libxml/xmlreader.h>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Compile-time generated extractors over a libxml2 pull reader. A schema is
+// a list of fields, for example
+//
+//   using Sites = Extractor<"measurementSiteRecord",
+//                           Field<"measurementSiteRecord", std::string, "id">,
+//                           Field<"latitude", std::vector<double>>>;
+//
+// and the extractor's state is a tuple holding one value per field. For
+// each start tag the local name is matched against the field names (length
+// first, then the bytes, all constants), and the matching field's text or
+// attribute is parsed into its slot by code chosen from its type: double,
+// integral, std::string, or std::vector of those to collect every
+// occurrence. At the end tag of the record element the sink is called with
+// the values; per-record fields are cleared when the next record starts.
+// Everything is instantiated per schema, so there is no runtime dispatch or
+// virtual call.
+
+// String literal usable as a template argument
+template <std::size_t N> struct FixedString
+{
+    // NOLINTNEXTLINE[cppcoreguidelines-avoid-c-arrays]
+    constexpr FixedString(const char (&text)[N]) // NOLINT(google-explicit-constructor)
+    {
+        std::copy_n(text, N, chars);
+    }
+
+    [[nodiscard]] constexpr std::string_view view() const
+    {
+        return {chars, N - 1};
+    }
+
+    char chars[N] = {}; // NOLINT[cppcoreguidelines-avoid-c-arrays]
+};
+
+// Element field: the text of <Name>, or its attribute Attribute when given.
+// Document fields keep their value across records (publicationTime).
+template <FixedString Name,
+          typename T,
+          FixedString Attribute = "",
+          bool PerRecord = true>
+struct Field
+{
+    using type = T;
+    static constexpr std::string_view name = Name.view();
+    static constexpr std::string_view attribute = Attribute.view();
+    static constexpr const char* attributeName = Attribute.chars;
+    static constexpr bool perRecord = PerRecord;
+};
+
+template <FixedString Name, typename T, FixedString Attribute = "">
+using DocumentField = Field<Name, T, Attribute, false>;
+
+namespace extractor_detail
+{
+
+template <typename T> struct IsVector : std::false_type
+{
+};
+
+template <typename T, typename A>
+struct IsVector<std::vector<T, A>> : std::true_type
+{
+};
+
+// Parse text into a scalar; false when it does not start with a value
+template <typename T> inline bool parseScalar(const char* text, T& out)
+{
+    if constexpr (std::is_same_v<T, std::string>)
+    {
+        out.assign(text);
+        return true;
+    }
+    else
+    {
+        char* end = nullptr;
+        T value{};
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            value = static_cast<T>(std::strtod(text, &end));
+        }
+        else
+        {
+            static_assert(std::is_integral_v<T>, "unsupported field type");
+            constexpr int decimal = 10;
+            value = static_cast<T>(std::strtoll(text, &end, decimal));
+        }
+        if (end == text)
+        {
+            return false;
+        }
+        out = value;
+        return true;
+    }
+}
+
+template <typename T> inline void store(const char* text, T& slot)
+{
+    if constexpr (IsVector<T>::value)
+    {
+        typename T::value_type value{};
+        if (parseScalar(text, value))
+        {
+            slot.push_back(std::move(value));
+        }
+    }
+    else
+    {
+        (void)parseScalar(text, slot);
+    }
+}
+
+template <typename T> inline void clear(T& slot)
+{
+    if constexpr (IsVector<T>::value || std::is_same_v<T, std::string>)
+    {
+        slot.clear();
+    }
+    else
+    {
+        slot = T{};
+    }
+}
+
+// No two fields may read the same element text or attribute
+template <typename... Fields> constexpr bool distinctFields()
+{
+    constexpr std::size_t count = sizeof...(Fields);
+    // NOLINTNEXTLINE[cppcoreguidelines-avoid-c-arrays]
+    const std::string_view names[count + 1] = {Fields::name...};
+    // NOLINTNEXTLINE[cppcoreguidelines-avoid-c-arrays]
+    const std::string_view attributes[count + 1] = {Fields::attribute...};
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        for (std::size_t j = i + 1; j < count; ++j)
+        {
+            if (names[i] == names[j] && attributes[i] == attributes[j])
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace extractor_detail
+
+template <FixedString Record, typename... Fields> class Extractor
+{
+    static_assert(extractor_detail::distinctFields<Fields...>(),
+                  "every field needs its own element or attribute");
+
+  public:
+    using Values = std::tuple<typename Fields::type...>;
+
+    // Pull every node from reader; sink(values) runs at each end tag of
+    // Record. Returns the last xmlTextReaderRead status: 0 at the end of
+    // the document, -1 on a read or parse error.
+    template <typename Sink> int run(xmlTextReaderPtr reader, Sink&& sink)
+    {
+        int status = 0;
+        while ((status = xmlTextReaderRead(reader)) == 1)
+        {
+            const int nodeType = xmlTextReaderNodeType(reader);
+            if (nodeType != XML_READER_TYPE_ELEMENT &&
+                nodeType != XML_READER_TYPE_END_ELEMENT)
+            {
+                continue;
+            }
+            // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+            const auto* local = reinterpret_cast<const char*>(
+                xmlTextReaderConstLocalName(reader));
+            if (local == nullptr)
+            {
+                continue;
+            }
+            const std::string_view name(local);
+            if (nodeType == XML_READER_TYPE_ELEMENT)
+            {
+                if (name == recordName)
+                {
+                    resetRecord(std::index_sequence_for<Fields...>{});
+                }
+                (void)dispatch(
+                    name, reader, std::index_sequence_for<Fields...>{});
+            }
+            else if (name == recordName)
+            {
+                sink(static_cast<const Values&>(values_));
+            }
+        }
+        return status;
+    }
+
+    [[nodiscard]] const Values& values() const { return values_; }
+
+  private:
+    static constexpr std::string_view recordName = Record.view();
+
+    template <std::size_t I>
+    using FieldAt = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+    template <std::size_t... I>
+    void resetRecord(std::index_sequence<I...> /*unused*/)
+    {
+        (
+            [this]
+            {
+                if constexpr (FieldAt<I>::perRecord)
+                {
+                    extractor_detail::clear(std::get<I>(values_));
+                }
+            }(),
+            ...);
+    }
+
+    // Store every field named name; an element can feed its text and
+    // several attributes
+    template <std::size_t... I>
+    bool dispatch(std::string_view name,
+                  xmlTextReaderPtr reader,
+                  std::index_sequence<I...> /*unused*/)
+    {
+        bool matched = false;
+        (
+            [&]
+            {
+                if (name == FieldAt<I>::name)
+                {
+                    store<I>(reader);
+                    matched = true;
+                }
+            }(),
+            ...);
+        return matched;
+    }
+
+    template <std::size_t I> void store(xmlTextReaderPtr reader)
+    {
+        using F = FieldAt<I>;
+        xmlChar* text = nullptr;
+        if constexpr (F::attribute.empty())
+        {
+            text = xmlTextReaderReadString(reader);
+        }
+        else
+        {
+            // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+            text = xmlTextReaderGetAttribute(
+                reader, reinterpret_cast<const xmlChar*>(F::attributeName));
+        }
+        if (text == nullptr)
+        {
+            return;
+        }
+        // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+        extractor_detail::store(reinterpret_cast<const char*>(text),
+                                std::get<I>(values_));
+        xmlFree(text);
+    }
+
+    Values values_;
+};
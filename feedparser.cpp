@@ -0,0 +1,1420 @@
+#include "feedparser.hpp"
+#include "packformat.hpp"
+#include "records.hpp"
+#include "sitefilter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <libxml/xmlstring.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+// Compare libxml2 xmlChar* local name with a C string
+static inline bool nameIs(const xmlChar* local, const char* key)
+{
+    // NOLINTBEGIN[cppcoreguidelines-pro-type-reinterpret-cast]
+    return local != nullptr &&
+           (xmlStrEqual(local, reinterpret_cast<const xmlChar*>(key)) != 0);
+    // NOLINTEND[cppcoreguidelines-pro-type-reinterpret-cast]
+}
+
+// Read element text as long (vehicleFlowRate) without any casts
+static inline bool readElementLong(xmlTextReaderPtr reader, long& out)
+{
+    xmlChar* txt = xmlTextReaderReadString(reader);
+    if (txt == nullptr)
+    {
+        return false;
+    }
+
+    const auto len = static_cast<size_t>(xmlStrlen(txt));
+    std::string str(len, '\0');
+    std::copy_n(txt, len, str.begin());
+    xmlFree(txt);
+
+    char* end = nullptr;
+    const unsigned int decimal = 10;
+    long value = std::strtol(str.c_str(), &end, decimal);
+    if (end == str.c_str())
+    {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+// Read element text as double (speed: supports floats)
+static inline bool readElementDouble(xmlTextReaderPtr reader, double& out)
+{
+    xmlChar* txt = xmlTextReaderReadString(reader);
+    if (txt == nullptr)
+    {
+        return false;
+    }
+
+    const auto len = static_cast<size_t>(xmlStrlen(txt));
+    std::string str(len, '\0');
+    std::copy_n(txt, len, str.begin());
+    xmlFree(txt);
+
+    char* end = nullptr;
+    double value = std::strtod(str.c_str(), &end);
+    if (end == str.c_str())
+    {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+static inline bool readElementString(xmlTextReaderPtr reader, std::string& out)
+{
+    xmlChar* txt = xmlTextReaderReadString(reader);
+    if (txt == nullptr)
+    {
+        out.clear();
+        return false;
+    }
+
+    const auto len = static_cast<size_t>(xmlStrlen(txt));
+    out.resize(len);
+    if (len > 0)
+    {
+        std::copy_n(txt, len, out.begin());
+    }
+
+    xmlFree(txt);
+    return true;
+}
+
+static inline bool
+readAttribute(xmlTextReaderPtr reader, const char* name, std::string& out)
+{
+    // NOLINTBEGIN[cppcoreguidelines-pro-type-reinterpret-cast]
+    xmlChar* val = xmlTextReaderGetAttribute(
+        reader, reinterpret_cast<const xmlChar*>(name));
+    // NOLINTEND[cppcoreguidelines-pro-type-reinterpret-cast]
+    if (val == nullptr)
+    {
+        out.clear();
+        return false;
+    }
+    const auto len = static_cast<size_t>(xmlStrlen(val));
+    out.resize(len);
+    if (len > 0)
+    {
+        std::copy_n(val, len, out.begin());
+    }
+    xmlFree(val);
+    return true;
+}
+
+// Build libxml2 options as unsigned to satisfy hicpp-signed-bitwise
+int xmlReaderOptions()
+{
+    constexpr unsigned int optsUnsigned =
+        static_cast<unsigned int>(XML_PARSE_NOERROR) |
+        static_cast<unsigned int>(XML_PARSE_NOWARNING) |
+        static_cast<unsigned int>(XML_PARSE_NOBLANKS);
+    return static_cast<int>(optsUnsigned);
+}
+
+void writeBlock(std::ostream& out,
+                const std::string& siteId,
+                const std::vector<Measurement>& pairs)
+{
+    const char* site = siteId.empty() ? "(unknown_site)" : siteId.c_str();
+    unsigned int idx = 1;
+    for (const Measurement& pair : pairs)
+    {
+        out << idx++ << ' ' << site << ' ' << std::defaultfloat << pair.speed
+            << ' ' << pair.flow << '\n';
+    }
+}
+
+void writeColumns(std::ostream& out,
+                  const std::string& siteId,
+                  const ColumnSet& columns,
+                  const std::vector<ColumnRow>& rows)
+{
+    const char* site = siteId.empty() ? "(unknown_site)" : siteId.c_str();
+    unsigned int idx = 1;
+    for (const ColumnRow& row : rows)
+    {
+        out << idx++ << ' ' << site << std::defaultfloat;
+        for (const Column column : columns.order)
+        {
+            out << ' ';
+            switch (column)
+            {
+            case Column::Speed:
+                std::isnan(row.speed) ? out << '-' : out << row.speed;
+                break;
+            case Column::Flow:
+                row.flow < 0 ? out << '-' : out << row.flow;
+                break;
+            case Column::StdDev:
+                std::isnan(row.stdDev) ? out << '-' : out << row.stdDev;
+                break;
+            case Column::Inputs:
+                row.inputs < 0 ? out << '-' : out << row.inputs;
+                break;
+            }
+        }
+        out << '\n';
+    }
+}
+
+bool ColumnSet::parse(std::string_view list)
+{
+    *this = ColumnSet();
+    while (!list.empty())
+    {
+        const std::size_t comma = list.find(',');
+        const std::string_view name = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view()
+                                               : list.substr(comma + 1);
+        Column column = Column::Speed;
+        bool* flag = nullptr;
+        if (name == "speed")
+        {
+            flag = &speed;
+        }
+        else if (name == "flow")
+        {
+            column = Column::Flow;
+            flag = &flow;
+        }
+        else if (name == "stddev")
+        {
+            column = Column::StdDev;
+            flag = &stdDev;
+        }
+        else if (name == "inputs")
+        {
+            column = Column::Inputs;
+            flag = &inputs;
+        }
+        if (flag == nullptr || *flag)
+        {
+            return false;
+        }
+        *flag = true;
+        order.push_back(column);
+    }
+    return !order.empty();
+}
+
+void emitBlock(std::ostream& out, const ParserState& state)
+{
+    if (state.batch != nullptr)
+    {
+        state.batch->append(state);
+    }
+    else if (state.columns != nullptr)
+    {
+        writeColumns(out, state.siteId, *state.columns, state.rows);
+    }
+    else if (state.binary)
+    {
+        writeBinaryBlock(out,
+                         state.siteId,
+                         state.measurementTime.empty() ? state.publicationTime
+                                                       : state.measurementTime,
+                         state.pairs);
+    }
+    else
+    {
+        writeBlock(out, state.siteId, state.pairs);
+    }
+}
+
+// Elements that frame a block, needed whatever is extracted from it
+static inline bool handleBlockElement(xmlTextReaderPtr reader,
+                                      const xmlChar* localName,
+                                      ParserState& state)
+{
+    if (nameIs(localName, "publicationTime"))
+    {
+        if (readElementString(reader, state.publicationTime) &&
+            state.out != nullptr && !state.binary)
+        {
+            *state.out << state.publicationTime << '\n';
+        }
+        return true;
+    }
+
+    if (nameIs(localName, "siteMeasurements"))
+    {
+        state.resetBlock();
+        return true;
+    }
+
+    if (nameIs(localName, "measurementTimeDefault"))
+    {
+        (void)readElementString(reader, state.measurementTime);
+        return true;
+    }
+
+    if (nameIs(localName, "measurementSiteReference"))
+    {
+        (void)readAttribute(reader, "id", state.siteId);
+        state.skipBlock = !state.accepts();
+        return true;
+    }
+
+    return false;
+}
+
+static inline bool handleStartElement(xmlTextReaderPtr reader,
+                                      const xmlChar* localName,
+                                      ParserState& state)
+{
+    if (handleBlockElement(reader, localName, state))
+    {
+        return true;
+    }
+
+    if (nameIs(localName, "speed"))
+    {
+        double speed = NAN;
+        if (readElementDouble(reader, speed))
+        {
+            state.speeds.push_back(speed);
+            state.matchPairs();
+        }
+        return true;
+    }
+
+    if (nameIs(localName, "vehicleFlowRate"))
+    {
+        long rate = 0;
+        if (readElementLong(reader, rate))
+        {
+            state.flows.push_back(rate);
+            state.matchPairs();
+        }
+        return true;
+    }
+
+    return false;
+}
+
+static inline bool handleEndElement(const xmlChar* localName,
+                                    ParserState& state)
+{
+    if (nameIs(localName, "siteMeasurements"))
+    {
+        state.finishBlock(); // drop leftovers without match
+        if (state.out != nullptr && !state.skipBlock)
+        {
+            emitBlock(*state.out, state);
+        }
+        return true;
+    }
+    return false;
+}
+
+static constexpr const char* xsiNamespace =
+    "http://www.w3.org/2001/XMLSchema-instance";
+
+enum class BasicDataType : std::uint8_t
+{
+    Untyped,
+    Flow,  // TrafficFlow: vehicleFlow/vehicleFlowRate
+    Speed, // TrafficSpeed: averageVehicleSpeed/speed
+    Other  // travel time, headway, ...: nothing the extractors use
+};
+
+// Type named by an xsi:type value, with or without a prefix
+static BasicDataType basicDataTypeOf(std::string_view name)
+{
+    const std::size_t colon = name.find(':');
+    if (colon != std::string_view::npos)
+    {
+        name.remove_prefix(colon + 1);
+    }
+    if (name == "TrafficFlow")
+    {
+        return BasicDataType::Flow;
+    }
+    if (name == "TrafficSpeed")
+    {
+        return BasicDataType::Speed;
+    }
+    return BasicDataType::Other;
+}
+
+// xsi:type of the basicData element the reader is on, found by a scan of
+// its attribute nodes and compared in place; leaves the reader on the
+// element. A block parsed on its own may lack the xsi declaration, so an
+// unbound "xsi:type" counts too.
+static BasicDataType basicDataType(xmlTextReaderPtr reader)
+{
+    BasicDataType type = BasicDataType::Untyped;
+    for (int more = xmlTextReaderMoveToFirstAttribute(reader); more == 1;
+         more = xmlTextReaderMoveToNextAttribute(reader))
+    {
+        const xmlChar* uri = xmlTextReaderConstNamespaceUri(reader);
+        const bool xsiType =
+            uri != nullptr
+                ? nameIs(uri, xsiNamespace) &&
+                      nameIs(xmlTextReaderConstLocalName(reader), "type")
+                : nameIs(xmlTextReaderConstName(reader), "xsi:type");
+        if (!xsiType)
+        {
+            continue;
+        }
+        const xmlChar* value = xmlTextReaderConstValue(reader);
+        // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+        type = basicDataTypeOf(value == nullptr
+                                   ? std::string_view()
+                                   : reinterpret_cast<const char*>(value));
+        break;
+    }
+    (void)xmlTextReaderMoveToElement(reader);
+    return type;
+}
+
+// Whether the basicData element the reader is on carries data of a
+// requested column, judged by its xsi:type
+static bool basicDataWanted(xmlTextReaderPtr reader, const ColumnSet& columns)
+{
+    switch (basicDataType(reader))
+    {
+    case BasicDataType::Untyped:
+        return true; // look inside
+    case BasicDataType::Flow:
+        return columns.flow;
+    case BasicDataType::Speed:
+        return columns.speedData();
+    case BasicDataType::Other:
+        break;
+    }
+    return false;
+}
+
+// Move from the basicData element the reader is on to the first leaf
+// element named leaf inside it; false, with the reader on the basicData
+// end tag, when there is none
+static bool descendTo(xmlTextReaderPtr reader, const char* leaf)
+{
+    if (xmlTextReaderIsEmptyElement(reader) == 1)
+    {
+        return false;
+    }
+    const int depth = xmlTextReaderDepth(reader);
+    while (xmlTextReaderRead(reader) == 1 &&
+           xmlTextReaderDepth(reader) > depth)
+    {
+        if (xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT &&
+            nameIs(xmlTextReaderConstLocalName(reader), leaf))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Leave the rest of a basicData subtree unvisited: from a node inside it,
+// move to its end tag
+static void leaveBasicData(xmlTextReaderPtr reader, int basicDepth)
+{
+    while (xmlTextReaderDepth(reader) > basicDepth &&
+           xmlTextReaderNext(reader) == 1)
+    {
+    }
+}
+
+// A typed basicData goes straight to the leaf value its type promises;
+// other types are skipped whole. Returns false for untyped basicData, which
+// the generic element handlers walk instead.
+static bool handleBasicData(xmlTextReaderPtr reader, ParserState& state)
+{
+    const BasicDataType type = basicDataType(reader);
+    if (type == BasicDataType::Untyped)
+    {
+        return false;
+    }
+    const int depth = xmlTextReaderDepth(reader);
+    if (type == BasicDataType::Speed && descendTo(reader, "speed"))
+    {
+        double speed = NAN;
+        if (readElementDouble(reader, speed))
+        {
+            state.speeds.push_back(speed);
+            state.matchPairs();
+        }
+    }
+    else if (type == BasicDataType::Flow && descendTo(reader, "vehicleFlowRate"))
+    {
+        long rate = 0;
+        if (readElementLong(reader, rate))
+        {
+            state.flows.push_back(rate);
+            state.matchPairs();
+        }
+    }
+    else if (type == BasicDataType::Other &&
+             xmlTextReaderIsEmptyElement(reader) != 1)
+    {
+        (void)xmlTextReaderRead(reader); // first child
+    }
+    leaveBasicData(reader, depth);
+    return true;
+}
+
+// Read a numeric attribute of the current element into out
+static inline void readAttributeNumber(xmlTextReaderPtr reader,
+                                       const char* name,
+                                       double& out)
+{
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    xmlChar* val = xmlTextReaderGetAttribute(
+        reader, reinterpret_cast<const xmlChar*>(name));
+    if (val == nullptr)
+    {
+        return;
+    }
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    const char* text = reinterpret_cast<const char*>(val);
+    char* end = nullptr;
+    const double value = std::strtod(text, &end);
+    if (end != text)
+    {
+        out = value;
+    }
+    xmlFree(val);
+}
+
+static inline void closeReading(ParserState& state)
+{
+    state.readings.push_back(state.reading);
+    state.matchRows();
+}
+
+// Start tag under --columns; false when the subtree of the element is not
+// needed and should be skipped
+static inline bool handleProjectedStart(xmlTextReaderPtr reader,
+                                        const xmlChar* localName,
+                                        ParserState& state)
+{
+    if (handleBlockElement(reader, localName, state))
+    {
+        return true;
+    }
+    const ColumnSet& columns = *state.columns;
+
+    if (nameIs(localName, "basicData"))
+    {
+        return (columns.flow && columns.speedData()) ||
+               basicDataWanted(reader, columns);
+    }
+
+    if (columns.speedData() && nameIs(localName, "averageVehicleSpeed"))
+    {
+        state.reading = ColumnRow();
+        if (columns.stdDev)
+        {
+            readAttributeNumber(reader, "standardDeviation", state.reading.stdDev);
+        }
+        if (columns.inputs)
+        {
+            double inputs = -1;
+            readAttributeNumber(reader, "numberOfInputValuesUsed", inputs);
+            state.reading.inputs = static_cast<long>(inputs);
+        }
+        if (xmlTextReaderIsEmptyElement(reader) == 1)
+        {
+            closeReading(state);
+        }
+        return true;
+    }
+
+    if (columns.speed && nameIs(localName, "speed"))
+    {
+        (void)readElementDouble(reader, state.reading.speed);
+        return true;
+    }
+
+    if (columns.flow && nameIs(localName, "vehicleFlowRate"))
+    {
+        long rate = 0;
+        if (readElementLong(reader, rate))
+        {
+            state.flows.push_back(rate);
+            state.matchRows();
+        }
+    }
+    return true;
+}
+
+static inline void handleProjectedEnd(const xmlChar* localName,
+                                      ParserState& state)
+{
+    if (state.columns->speedData() && nameIs(localName, "averageVehicleSpeed"))
+    {
+        closeReading(state);
+        return;
+    }
+    (void)handleEndElement(localName, state);
+}
+
+bool ParserState::accepts() const
+{
+    return filter == nullptr || filter->contains(siteId);
+}
+
+// Skip the siblings of the measurementSiteReference the reader is on, so
+// the rest of a filtered siteMeasurements subtree is never parsed; the
+// reader ends on the siteMeasurements end tag
+static void skipSiteMeasurements(xmlTextReaderPtr reader, ParserState& state)
+{
+    const int depth = xmlTextReaderDepth(reader);
+    while (xmlTextReaderNext(reader) == 1 &&
+           xmlTextReaderDepth(reader) >= depth)
+    {
+    }
+    state.resetBlock();
+}
+
+// processReader under --columns: only the requested columns are decoded
+static void processProjected(xmlTextReaderPtr reader, ParserState& state)
+{
+    int status = xmlTextReaderRead(reader);
+    while (status == 1)
+    {
+        const int nodeType = xmlTextReaderNodeType(reader);
+        const xmlChar* localName = xmlTextReaderConstLocalName(reader);
+
+        if (nodeType == XML_READER_TYPE_ELEMENT)
+        {
+            if (!handleProjectedStart(reader, localName, state))
+            {
+                status = xmlTextReaderNext(reader); // past the subtree
+                continue;
+            }
+            if (state.skipBlock)
+            {
+                skipSiteMeasurements(reader, state);
+            }
+        }
+        else if (nodeType == XML_READER_TYPE_END_ELEMENT)
+        {
+            handleProjectedEnd(localName, state);
+        }
+        status = xmlTextReaderRead(reader);
+    }
+}
+
+void processReader(xmlTextReaderPtr reader, ParserState& state)
+{
+    if (state.columns != nullptr)
+    {
+        processProjected(reader, state);
+        return;
+    }
+    while (xmlTextReaderRead(reader) == 1)
+    {
+        const int nodeType = xmlTextReaderNodeType(reader);
+        const xmlChar* localName = xmlTextReaderConstLocalName(reader);
+
+        if (nodeType == XML_READER_TYPE_ELEMENT)
+        {
+            if (nameIs(localName, "basicData") &&
+                handleBasicData(reader, state))
+            {
+                continue;
+            }
+            (void)handleStartElement(reader, localName, state);
+            if (state.skipBlock)
+            {
+                skipSiteMeasurements(reader, state);
+            }
+        }
+        else if (nodeType == XML_READER_TYPE_END_ELEMENT)
+        {
+            (void)handleEndElement(localName, state);
+        }
+    }
+}
+
+InputBuffer::~InputBuffer()
+{
+    if (mapped_ != nullptr)
+    {
+        (void)munmap(mapped_, size_);
+    }
+}
+
+bool InputBuffer::load(int fd, std::string_view head)
+{
+    struct stat info = {};
+    if (head.empty() && fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+        info.st_size > 0)
+    {
+        const auto size = static_cast<std::size_t>(info.st_size);
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            (void)madvise(addr, size, MADV_SEQUENTIAL);
+            mapped_ = addr;
+            size_ = size;
+            return true;
+        }
+    }
+
+    owned_ = head;
+    constexpr std::size_t chunkSize = 64 * 1024;
+    std::vector<char> chunk(chunkSize);
+    ssize_t got = 0;
+    while ((got = read(fd, chunk.data(), chunk.size())) > 0)
+    {
+        owned_.append(chunk.data(), static_cast<std::size_t>(got));
+    }
+    return got == 0;
+}
+
+std::size_t skipOpaque(std::string_view doc, std::size_t pos)
+{
+    struct Opaque
+    {
+        std::string_view open;
+        std::string_view close;
+    };
+
+    static constexpr Opaque kinds[] = {
+        {"<!--", "-->"}, {"<![CDATA[", "]]>"}, {"<?", "?>"}};
+
+    for (const Opaque& kind : kinds)
+    {
+        if (doc.compare(pos, kind.open.size(), kind.open) == 0)
+        {
+            const std::size_t end = doc.find(kind.close, pos + kind.open.size());
+            return end == std::string_view::npos ? doc.size()
+                                                 : end + kind.close.size();
+        }
+    }
+    return pos;
+}
+
+bool findBlock(std::string_view doc, std::size_t from, BlockSpan& span)
+{
+    constexpr std::string_view open = "<siteMeasurements";
+    constexpr std::string_view close = "</siteMeasurements>";
+
+    std::size_t begin = std::string_view::npos;
+    std::size_t pos = doc.find('<', from);
+    while (pos != std::string_view::npos)
+    {
+        const std::size_t skipped = skipOpaque(doc, pos);
+        if (skipped != pos)
+        {
+            pos = doc.find('<', skipped);
+            continue;
+        }
+
+        if (begin == std::string_view::npos)
+        {
+            const std::size_t next = pos + open.size();
+            if (doc.compare(pos, open.size(), open) == 0 &&
+                next < doc.size() &&
+                (doc[next] == ' ' || doc[next] == '>' || doc[next] == '\t' ||
+                 doc[next] == '\n' || doc[next] == '\r'))
+            {
+                begin = pos;
+            }
+        }
+        else if (doc.compare(pos, close.size(), close) == 0)
+        {
+            span.begin = begin;
+            span.end = pos + close.size();
+            return true;
+        }
+        pos = doc.find('<', pos + 1);
+    }
+    return false;
+}
+
+bool scanBlockSiteId(std::string_view block, std::string_view& id)
+{
+    constexpr std::string_view open = "<measurementSiteReference";
+
+    std::size_t pos = block.find('<');
+    while (pos != std::string_view::npos)
+    {
+        const std::size_t skipped = skipOpaque(block, pos);
+        if (skipped != pos)
+        {
+            pos = block.find('<', skipped);
+            continue;
+        }
+        const std::size_t next = pos + open.size();
+        if (block.compare(pos, open.size(), open) == 0 && next < block.size() &&
+            std::isspace(static_cast<unsigned char>(block[next])) != 0)
+        {
+            const std::size_t end = block.find('>', next);
+            const std::string_view tag = block.substr(next, end - next);
+            for (std::size_t at = tag.find("id="); at != std::string_view::npos;
+                 at = tag.find("id=", at + 1))
+            {
+                const std::size_t quote = at + 3;
+                if (std::isspace(static_cast<unsigned char>(tag[at - 1])) == 0 ||
+                    quote >= tag.size() ||
+                    (tag[quote] != '"' && tag[quote] != '\''))
+                {
+                    continue;
+                }
+                const std::size_t close = tag.find(tag[quote], quote + 1);
+                if (close == std::string_view::npos)
+                {
+                    return false;
+                }
+                id = tag.substr(quote + 1, close - quote - 1);
+                // Entity references need the parser
+                return id.find('&') == std::string_view::npos;
+            }
+            return false;
+        }
+        pos = block.find('<', pos + 1);
+    }
+    return false;
+}
+
+std::string rootElementName(std::string_view header)
+{
+    std::size_t pos = header.find('<');
+    while (pos != std::string_view::npos)
+    {
+        const std::size_t skipped = skipOpaque(header, pos);
+        if (skipped == pos && header.compare(pos, 2, "<!") != 0)
+        {
+            const std::size_t end = header.find_first_of(" \t\r\n/>", pos);
+            if (end == std::string_view::npos)
+            {
+                return {};
+            }
+            return std::string(header.substr(pos + 1, end - pos - 1));
+        }
+        pos = header.find('<', skipped == pos ? pos + 1 : skipped);
+    }
+    return {};
+}
+
+FragmentParser::~FragmentParser()
+{
+    if (reader_ != nullptr)
+    {
+        xmlFreeTextReader(reader_);
+    }
+}
+
+bool FragmentParser::parse(std::string_view fragment, ParserState& state)
+{
+    const auto size = static_cast<int>(fragment.size());
+    if (reader_ == nullptr)
+    {
+        reader_ = xmlReaderForMemory(
+            fragment.data(), size, "fragment", nullptr, xmlReaderOptions());
+        if (reader_ == nullptr)
+        {
+            return false;
+        }
+    }
+    else if (xmlReaderNewMemory(reader_,
+                                fragment.data(),
+                                size,
+                                "fragment",
+                                nullptr,
+                                xmlReaderOptions()) != 0)
+    {
+        return false;
+    }
+    processReader(reader_, state);
+    return true;
+}
+
+std::uint64_t hashBytes(std::string_view bytes, std::uint64_t seed)
+{
+    constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr std::size_t word = sizeof(std::uint64_t);
+
+    std::uint64_t hash = seed ^ (bytes.size() * prime1);
+    std::size_t pos = 0;
+    std::uint64_t lane = 0;
+    for (; pos + word <= bytes.size(); pos += word)
+    {
+        std::memcpy(&lane, bytes.data() + pos, word);
+        hash ^= lane * prime2;
+        hash = ((hash << 31U) | (hash >> 33U)) * prime1;
+    }
+    lane = 0;
+    std::memcpy(&lane, bytes.data() + pos, bytes.size() - pos);
+    hash ^= lane * prime2;
+
+    hash ^= hash >> 33U;
+    hash *= prime2;
+    hash ^= hash >> 29U;
+    return hash;
+}
+
+constexpr std::string_view measurementTimeOpen = "<measurementTimeDefault>";
+constexpr std::string_view measurementTimeClose = "</measurementTimeDefault>";
+
+std::string_view blockMeasurementTime(std::string_view block)
+{
+    const std::size_t begin = block.find(measurementTimeOpen);
+    const std::size_t end = begin == std::string_view::npos
+                                ? std::string_view::npos
+                                : block.find(measurementTimeClose, begin);
+    if (end == std::string_view::npos)
+    {
+        return {};
+    }
+    return block.substr(begin + measurementTimeOpen.size(),
+                        end - begin - measurementTimeOpen.size());
+}
+
+std::uint64_t maskedBlockHash(std::string_view block)
+{
+    constexpr std::uint64_t seed = 0x27D4EB2F165667C5ULL;
+
+    const std::size_t begin = block.find(measurementTimeOpen);
+    const std::size_t end = begin == std::string_view::npos
+                                ? std::string_view::npos
+                                : block.find(measurementTimeClose, begin);
+    if (end == std::string_view::npos)
+    {
+        return hashBytes(block, seed);
+    }
+    const std::uint64_t head =
+        hashBytes(block.substr(0, begin + measurementTimeOpen.size()), seed);
+    return hashBytes(block.substr(end), head);
+}
+
+bool BlockMemo::find(std::uint64_t key, std::size_t length, ParserState& state)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end() || it->second.length != length)
+    {
+        return false;
+    }
+    it->second.lastUsed = generation_;
+    state.siteId = it->second.siteId;
+    state.pairs = it->second.pairs;
+    state.rows = it->second.rows;
+    return true;
+}
+
+void BlockMemo::store(std::uint64_t key,
+                      std::size_t length,
+                      const ParserState& state)
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    CachedBlock& entry = entries_[key];
+    entry.length = length;
+    entry.lastUsed = generation_;
+    entry.siteId = state.siteId;
+    entry.pairs = state.pairs;
+    entry.rows = state.rows;
+}
+
+void BlockMemo::endPublication()
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    std::erase_if(entries_,
+                  [this](const auto& item)
+                  { return item.second.lastUsed != generation_; });
+    ++generation_;
+}
+
+void BlockStats::report(std::ostream& out) const
+{
+    const double parseMs =
+        std::chrono::duration<double, std::milli>(parseTime).count();
+    const double perBlockMs =
+        parsed == 0 ? 0.0 : parseMs / static_cast<double>(parsed);
+    const double hitRate = blocks == 0 ? 0.0
+                                       : 100.0 * static_cast<double>(memoHits) /
+                                             static_cast<double>(blocks);
+    out << "blocks: " << blocks << " parsed: " << parsed
+        << " parse ms: " << parseMs << '\n'
+        << "memo hits: " << memoHits << " (" << std::fixed
+        << std::setprecision(1) << hitRate << "%) saved ms: "
+        << perBlockMs * static_cast<double>(memoHits) << std::defaultfloat
+        << '\n';
+    if (filtered != 0)
+    {
+        out << "filtered: " << filtered << '\n';
+    }
+}
+
+// Copy block to out without the measuredValue entries whose basicData
+// xsi:type names data of no requested column, so that libxml2 never sees
+// them (pairs are matched by order, not by index); false, leaving out
+// alone, when every type is wanted or the block holds comments or CDATA
+// that a plain text scan could misread
+static bool projectBlock(std::string_view block,
+                         const ColumnSet& columns,
+                         std::string& out)
+{
+    constexpr std::string_view entry = "<measuredValue index=";
+    constexpr std::string_view nested = "<measuredValue";
+    constexpr std::string_view data = "<basicData";
+    constexpr std::string_view typeAttribute = "type=\"";
+    constexpr std::string_view dataEnd = "</basicData>";
+    constexpr std::string_view entryEnd = "</measuredValue>";
+    if ((columns.flow && columns.speedData()) ||
+        block.find("<!") != std::string_view::npos)
+    {
+        return false;
+    }
+
+    out.clear();
+    std::size_t copied = 0;
+    std::size_t pos = block.find(entry);
+    while (pos != std::string_view::npos)
+    {
+        const std::size_t next = block.find(entry, pos + entry.size());
+        const std::size_t basic = block.find(data, pos);
+        const std::size_t tagEnd = block.find('>', basic);
+        if (basic >= next || tagEnd == std::string_view::npos)
+        {
+            pos = next;
+            continue;
+        }
+        const std::string_view tag = block.substr(basic, tagEnd - basic);
+        const std::size_t type = tag.find(typeAttribute);
+        const BasicDataType kind =
+            type == std::string_view::npos
+                ? BasicDataType::Untyped
+                : basicDataTypeOf(tag.substr(
+                      type + typeAttribute.size(),
+                      tag.find('"', type + typeAttribute.size()) - type -
+                          typeAttribute.size()));
+        if (kind == BasicDataType::Untyped ||
+            (kind == BasicDataType::Flow && columns.flow) ||
+            (kind == BasicDataType::Speed && columns.speedData()))
+        {
+            pos = next;
+            continue;
+        }
+
+        // The entry ends after as many measuredValue end tags as it opened
+        // before its basicData
+        std::size_t end = tagEnd + 1;
+        if (block[tagEnd - 1] != '/')
+        {
+            end = block.find(dataEnd, tagEnd);
+            end = end == std::string_view::npos ? end : end + dataEnd.size();
+        }
+        for (std::size_t open = block.find(nested, pos);
+             open < basic && end != std::string_view::npos;
+             open = block.find(nested, open + nested.size()))
+        {
+            end = block.find(entryEnd, end);
+            end = end == std::string_view::npos ? end : end + entryEnd.size();
+        }
+        if (end == std::string_view::npos || end > next)
+        {
+            pos = next;
+            continue;
+        }
+        out.append(block.substr(copied, pos - copied));
+        copied = end;
+        pos = next;
+    }
+    out.append(block.substr(copied));
+    return true;
+}
+
+void BlockEngine::processBlock(std::string_view block, std::ostream& out)
+{
+    ++stats.blocks;
+    std::string_view id;
+    if (state.filter != nullptr && scanBlockSiteId(block, id) &&
+        !state.filter->contains(id))
+    {
+        ++stats.filtered;
+        return;
+    }
+    const std::uint64_t key = memo != nullptr ? maskedBlockHash(block) : 0;
+    if (memo != nullptr && memo->find(key, block.size(), state))
+    {
+        ++stats.memoHits;
+        state.measurementTime = blockMeasurementTime(block);
+        if (state.accepts())
+        {
+            emitBlock(out, state);
+        }
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    state.resetBlock();
+    (void)parser.parse(state.columns != nullptr &&
+                               projectBlock(block, *state.columns, projected)
+                           ? std::string_view(projected)
+                           : block,
+                       state);
+    stats.parseTime += std::chrono::steady_clock::now() - start;
+    ++stats.parsed;
+    if (!state.accepts())
+    {
+        ++stats.filtered;
+        return;
+    }
+
+    emitBlock(out, state);
+    if (memo != nullptr)
+    {
+        memo->store(key, block.size(), state);
+    }
+}
+
+std::size_t BlockEngine::processRange(std::string_view doc,
+                                      std::size_t start,
+                                      std::size_t to,
+                                      std::ostream& out)
+{
+    BlockSpan span;
+    std::size_t pos = start;
+    while (pos != std::string_view::npos && findBlock(doc, pos, span))
+    {
+        if (span.begin >= to)
+        {
+            return span.begin;
+        }
+        const std::size_t filtered = stats.filtered;
+        processBlock(doc.substr(span.begin, span.end - span.begin), out);
+        if (recordLocations && stats.filtered == filtered)
+        {
+            locations.push_back(
+                {state.siteId, span.begin, span.end - span.begin});
+        }
+        pos = span.end;
+    }
+    return std::string_view::npos;
+}
+
+void BlockEngine::processHeader(std::string_view header, std::ostream& out)
+{
+    ParserState headerState;
+    headerState.out = &out;
+    headerState.binary = state.binary;
+    (void)parser.parse(header, headerState);
+}
+
+// Part of a document parsed by one thread in speculative parallel mode
+struct Region
+{
+    std::size_t to = 0;
+    std::size_t first = std::string_view::npos; // first block parsed
+    std::size_t next = std::string_view::npos;  // first block past to
+    BlockStats before;                           // engine stats to roll back
+    std::size_t rows = 0;                        // engine batch size before
+    std::ostringstream out;
+};
+
+// Speculative parallel parse: every engine but the first starts at an
+// arbitrary offset, assumes it is in element content and resynchronizes on
+// the next <siteMeasurements. A region is accepted when its first block is
+// the block its predecessor found past the shared boundary; otherwise the
+// offset was inside a comment, CDATA section or block and the region is
+// parsed again serially from the known-good position.
+static void processParallel(std::string_view doc,
+                            std::size_t firstBlock,
+                            std::vector<BlockEngine>& engines,
+                            std::ostream& out)
+{
+    const std::size_t count = engines.size();
+    const std::size_t stride = (doc.size() - firstBlock) / count + 1;
+    std::vector<Region> regions(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        regions[i].to = std::min(doc.size(), firstBlock + (i + 1) * stride);
+    }
+
+    auto speculate = [&](std::size_t i)
+    {
+        Region& region = regions[i];
+        std::size_t start = firstBlock;
+        if (i > 0)
+        {
+            BlockSpan span;
+            const std::size_t offset = regions[i - 1].to;
+            start = findBlock(doc, offset, span) ? span.begin
+                                                 : std::string_view::npos;
+        }
+        region.first = start;
+        region.before = engines[i].stats;
+        if (engines[i].state.batch != nullptr)
+        {
+            region.rows = engines[i].state.batch->size();
+        }
+        region.next = engines[i].processRange(doc, start, region.to, region.out);
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(count - 1);
+    for (std::size_t i = 1; i < count; ++i)
+    {
+        workers.emplace_back(speculate, i);
+    }
+    speculate(0);
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Region& region = regions[i];
+        if (i > 0 && region.first != regions[i - 1].next)
+        {
+            region.out.str({});
+            engines[i].stats = region.before;
+            engines[i].locations.clear();
+            if (engines[i].state.batch != nullptr)
+            {
+                engines[i].state.batch->truncate(region.rows);
+            }
+            region.first = regions[i - 1].next;
+            region.next = engines[i].processRange(
+                doc, region.first, region.to, region.out);
+        }
+        out << region.out.view();
+    }
+}
+
+void processDocument(std::string_view doc,
+                     std::vector<BlockEngine>& engines,
+                     BlockMemo* memo,
+                     std::ostream& out)
+{
+    BlockSpan span;
+    const bool found = findBlock(doc, 0, span);
+    for (BlockEngine& engine : engines)
+    {
+        engine.locations.clear();
+    }
+
+    // The header before the first block carries the publicationTime
+    engines.front().processHeader(doc.substr(0, found ? span.begin : doc.size()),
+                                  out);
+
+    if (found && engines.size() > 1)
+    {
+        processParallel(doc, span.begin, engines, out);
+    }
+    else if (found)
+    {
+        (void)engines.front().processRange(doc, span.begin, doc.size(), out);
+    }
+
+    if (memo != nullptr)
+    {
+        memo->endPublication();
+    }
+}
+
+bool scanPublicationKey(std::string_view head, PublicationKey& key)
+{
+    constexpr std::string_view timeOpen = "<publicationTime>";
+    constexpr std::string_view timeClose = "</publicationTime>";
+    constexpr std::string_view reference = "<measurementSiteTableReference";
+    constexpr std::string_view version = "version=\"";
+
+    const std::size_t open = head.find(timeOpen);
+    const std::size_t close = open == std::string_view::npos
+                                  ? std::string_view::npos
+                                  : head.find(timeClose, open);
+    if (close == std::string_view::npos)
+    {
+        return false;
+    }
+    const std::size_t begin = open + timeOpen.size();
+    key.publicationTime = head.substr(begin, close - begin);
+
+    key.tableVersion.clear();
+    const std::size_t tag = head.find(reference);
+    const std::size_t tagEnd = tag == std::string_view::npos
+                                   ? std::string_view::npos
+                                   : head.find('>', tag);
+    const std::size_t attr = tagEnd == std::string_view::npos
+                                 ? std::string_view::npos
+                                 : head.find(version, tag);
+    if (attr != std::string_view::npos && attr < tagEnd)
+    {
+        const std::size_t value = attr + version.size();
+        const std::size_t quote = head.find('"', value);
+        if (quote != std::string_view::npos)
+        {
+            key.tableVersion = head.substr(value, quote - value);
+        }
+    }
+    return true;
+}
+
+static std::string indexEntry(const PublicationKey& key)
+{
+    return key.publicationTime + ' ' + key.tableVersion;
+}
+
+bool PublicationIndex::open(const std::string& path)
+{
+    path_ = path;
+    entries_.clear();
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty())
+        {
+            entries_.insert(line);
+        }
+    }
+    return !in.bad();
+}
+
+bool PublicationIndex::contains(const PublicationKey& key) const
+{
+    return !key.empty() && entries_.contains(indexEntry(key));
+}
+
+bool PublicationIndex::add(const PublicationKey& key)
+{
+    if (key.empty() || !entries_.insert(indexEntry(key)).second)
+    {
+        return true;
+    }
+    std::ofstream out(path_, std::ios::app);
+    out << indexEntry(key) << '\n';
+    return static_cast<bool>(out.flush());
+}
+
+void IncrementalDocument::feed(std::string_view chunk)
+{
+    if (skipped_)
+    {
+        return;
+    }
+    pending_.append(chunk);
+
+    BlockSpan span;
+    if (!headerDone_)
+    {
+        if (!findBlock(pending_, 0, span))
+        {
+            return;
+        }
+        parseHeader(span.begin);
+        if (skipped_)
+        {
+            pending_.clear();
+            return;
+        }
+        pos_ = span.begin;
+    }
+
+    while (findBlock(pending_, pos_, span))
+    {
+        engine_.processBlock(
+            std::string_view(pending_).substr(span.begin,
+                                              span.end - span.begin),
+            out_);
+        pos_ = span.end;
+    }
+    complete_ = !rootClose_.empty() &&
+                pending_.find(rootClose_, pos_) != std::string::npos;
+
+    pending_.erase(0, pos_);
+    pos_ = 0;
+}
+
+void IncrementalDocument::finish()
+{
+    if (!headerDone_ && !skipped_)
+    {
+        parseHeader(pending_.size());
+    }
+    if (engine_.memo != nullptr && !skipped_)
+    {
+        engine_.memo->endPublication();
+    }
+}
+
+void IncrementalDocument::parseHeader(std::size_t end)
+{
+    const std::string_view header = std::string_view(pending_).substr(0, end);
+    ParserState state;
+    state.out = nullptr;
+    (void)engine_.parser.parse(header, state);
+    headerDone_ = true;
+
+    PublicationKey key;
+    (void)scanPublicationKey(header, key);
+    if (check_ && !check_(key))
+    {
+        skipped_ = true;
+        return;
+    }
+    if (!state.publicationTime.empty() && !engine_.state.binary)
+    {
+        out_ << state.publicationTime << '\n';
+    }
+
+    const std::string root = rootElementName(header);
+    if (!root.empty())
+    {
+        rootClose_ = "</" + root + ">";
+    }
+}
+
+static bool isPackedPath(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::string head(packMagic.size(), '\0');
+    in.read(head.data(), static_cast<std::streamsize>(head.size()));
+    return in && isPacked(head);
+}
+
+std::vector<std::string> expandInputs(const std::vector<std::string>& args)
+{
+    std::vector<std::string> files;
+    for (const std::string& arg : args)
+    {
+        std::error_code error;
+        if (!std::filesystem::is_directory(arg, error))
+        {
+            files.push_back(arg);
+            continue;
+        }
+        std::vector<std::string> entries;
+        for (const auto& entry :
+             std::filesystem::directory_iterator(arg, error))
+        {
+            if (entry.is_regular_file(error) &&
+                (entry.path().extension() == ".xml" ||
+                 isPackedPath(entry.path().string())))
+            {
+                entries.push_back(entry.path().string());
+            }
+        }
+        std::sort(entries.begin(), entries.end());
+        files.insert(files.end(), entries.begin(), entries.end());
+    }
+    return files;
+}
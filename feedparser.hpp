@@ -0,0 +1,424 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <libxml/xmlreader.h>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Block parser shared by the NDW feed extractors: a libxml2 pull reader for
+// the streaming path plus an in-memory engine that splits documents into
+// <siteMeasurements> blocks and parses them one by one.
+
+// Build libxml2 options as unsigned to satisfy hicpp-signed-bitwise
+int xmlReaderOptions();
+
+class RecordBatch;
+class SiteFilter;
+
+struct Measurement
+{
+    double speed;
+    long flow;
+};
+
+// Output columns of xmline --columns
+enum class Column : std::uint8_t
+{
+    Speed,  // averageVehicleSpeed/speed
+    Flow,   // vehicleFlow/vehicleFlowRate
+    StdDev, // standardDeviation attribute of averageVehicleSpeed
+    Inputs  // numberOfInputValuesUsed attribute of averageVehicleSpeed
+};
+
+// Requested columns, consulted by the element handlers: text and attributes
+// of other columns are never decoded, and basicData subtrees whose xsi:type
+// feeds no requested column are skipped unparsed
+struct ColumnSet
+{
+    std::vector<Column> order;
+    bool speed = false;
+    bool flow = false;
+    bool stdDev = false;
+    bool inputs = false;
+
+    // Parse a comma separated list like "flow" or "speed,stddev"
+    bool parse(std::string_view list);
+
+    // Whether any column comes from TrafficSpeed data
+    [[nodiscard]] bool speedData() const { return speed || stdDev || inputs; }
+};
+
+// One output row under --columns; values that were absent stay NaN or -1
+struct ColumnRow
+{
+    double speed = NAN;
+    double stdDev = NAN;
+    long inputs = -1;
+    long flow = -1;
+};
+
+struct ParserState
+{
+    std::string publicationTime;
+    std::string siteId;
+    std::string measurementTime; // measurementTimeDefault of the block
+    std::deque<double> speeds;
+    std::deque<long> flows;
+    std::vector<Measurement> pairs;
+    std::ostream* out = &std::cout; // null when the caller collects output
+    const SiteFilter* filter = nullptr; // only these sites are written
+    bool skipBlock = false;             // current site is filtered out
+    bool binary = false;                // write block records, see records.hpp
+    RecordBatch* batch = nullptr;       // collect rows instead of writing
+    const ColumnSet* columns = nullptr; // projected rows instead of pairs
+    ColumnRow reading;                  // open averageVehicleSpeed
+    std::deque<ColumnRow> readings;
+    std::vector<ColumnRow> rows;
+
+    void resetBlock()
+    {
+        siteId.clear();
+        measurementTime.clear();
+        skipBlock = false;
+        speeds.clear();
+        flows.clear();
+        pairs.clear();
+        readings.clear();
+        rows.clear();
+    }
+
+    // Match queued speeds and flows in arrival order
+    void matchPairs()
+    {
+        while (!speeds.empty() && !flows.empty())
+        {
+            pairs.push_back({speeds.front(), flows.front()});
+            speeds.pop_front();
+            flows.pop_front();
+        }
+    }
+
+    // Form projected rows: speed readings matched with flows when both are
+    // requested, otherwise one row per reading or flow
+    void matchRows()
+    {
+        if (!columns->flow)
+        {
+            rows.insert(rows.end(), readings.begin(), readings.end());
+            readings.clear();
+            return;
+        }
+        if (!columns->speedData())
+        {
+            for (const long flow : flows)
+            {
+                rows.push_back({.flow = flow});
+            }
+            flows.clear();
+            return;
+        }
+        while (!readings.empty() && !flows.empty())
+        {
+            rows.push_back(readings.front());
+            rows.back().flow = flows.front();
+            readings.pop_front();
+            flows.pop_front();
+        }
+    }
+
+    // Whether the filter lets the current site through
+    [[nodiscard]] bool accepts() const;
+
+    // Match what is left at the end of a block and drop the remainder
+    void finishBlock()
+    {
+        if (columns != nullptr)
+        {
+            matchRows();
+            readings.clear();
+        }
+        else
+        {
+            matchPairs();
+            speeds.clear();
+        }
+        flows.clear();
+    }
+};
+
+void writeBlock(std::ostream& out,
+                const std::string& siteId,
+                const std::vector<Measurement>& pairs);
+
+// Write projected rows: idx site, then the columns in requested order with
+// "-" for absent values
+void writeColumns(std::ostream& out,
+                  const std::string& siteId,
+                  const ColumnSet& columns,
+                  const std::vector<ColumnRow>& rows);
+
+// Write the finished block of state as text lines, projected columns or a
+// binary record, or add it to state.batch
+void emitBlock(std::ostream& out, const ParserState& state);
+
+void processReader(xmlTextReaderPtr reader, ParserState& state);
+
+// Whole input document: mapped when it is a regular file, read otherwise
+class InputBuffer
+{
+  public:
+    InputBuffer() = default;
+    ~InputBuffer();
+
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+    InputBuffer(InputBuffer&&) = delete;
+    InputBuffer& operator=(InputBuffer&&) = delete;
+
+    // Map or read the whole input; head holds bytes already read from fd
+    bool load(int fd, std::string_view head = {});
+
+    [[nodiscard]] std::string_view view() const
+    {
+        if (mapped_ != nullptr)
+        {
+            return {static_cast<const char*>(mapped_), size_};
+        }
+        return owned_;
+    }
+
+  private:
+    void* mapped_ = nullptr;
+    std::size_t size_ = 0;
+    std::string owned_;
+};
+
+struct BlockSpan
+{
+    std::size_t begin = 0;
+    std::size_t end = 0;
+};
+
+// Position just past the comment, CDATA section or processing instruction
+// starting at pos; pos itself when the markup there is none of these
+std::size_t skipOpaque(std::string_view doc, std::size_t pos);
+
+// Find the next complete <siteMeasurements> element at or after from,
+// assuming from lies in element content (not inside markup)
+bool findBlock(std::string_view doc, std::size_t from, BlockSpan& span);
+
+// Value of the id attribute of the measurementSiteReference start tag of a
+// block, found without parsing; false when the block has no such tag
+bool scanBlockSiteId(std::string_view block, std::string_view& id);
+
+// Name of the root element of a document header, empty if not yet known
+std::string rootElementName(std::string_view header);
+
+// Reusable libxml2 reader over in-memory fragments of a document
+class FragmentParser
+{
+  public:
+    FragmentParser() = default;
+    ~FragmentParser();
+
+    FragmentParser(const FragmentParser&) = delete;
+    FragmentParser& operator=(const FragmentParser&) = delete;
+    FragmentParser(FragmentParser&&) = delete;
+    FragmentParser& operator=(FragmentParser&&) = delete;
+
+    bool parse(std::string_view fragment, ParserState& state);
+
+  private:
+    xmlTextReaderPtr reader_ = nullptr;
+};
+
+// 64-bit multiply-rotate hash over 8-byte words (xxh64-style rounds)
+std::uint64_t hashBytes(std::string_view bytes, std::uint64_t seed);
+
+// Raw measurementTimeDefault text of a block, empty when there is none
+std::string_view blockMeasurementTime(std::string_view block);
+
+// Hash a block with its measurementTimeDefault text masked out, so blocks
+// that only differ in their timestamp share one key
+std::uint64_t maskedBlockHash(std::string_view block);
+
+struct CachedBlock
+{
+    std::size_t length = 0;
+    std::uint64_t lastUsed = 0;
+    std::string siteId;
+    std::vector<Measurement> pairs;
+    std::vector<ColumnRow> rows;
+};
+
+// Parsed siteMeasurements blocks of the previous publication, keyed by
+// masked block hash, so unchanged blocks skip parsing entirely
+class BlockMemo
+{
+  public:
+    // Copy a cached result into state; false when the block is not known
+    bool find(std::uint64_t key, std::size_t length, ParserState& state);
+
+    void store(std::uint64_t key, std::size_t length, const ParserState& state);
+
+    // Forget blocks the finished publication did not contain
+    void endPublication();
+
+  private:
+    std::mutex mutex_;
+    std::unordered_map<std::uint64_t, CachedBlock> entries_;
+    std::uint64_t generation_ = 1;
+};
+
+struct BlockStats
+{
+    std::size_t blocks = 0;
+    std::size_t parsed = 0;
+    std::size_t memoHits = 0;
+    std::size_t filtered = 0;
+    std::chrono::nanoseconds parseTime{0};
+
+    BlockStats& operator+=(const BlockStats& other)
+    {
+        blocks += other.blocks;
+        parsed += other.parsed;
+        memoHits += other.memoHits;
+        filtered += other.filtered;
+        parseTime += other.parseTime;
+        return *this;
+    }
+
+    void report(std::ostream& out) const;
+};
+
+// Where the block of a site sits in its document
+struct BlockLocation
+{
+    std::string siteId;
+    std::size_t offset = 0;
+    std::size_t length = 0;
+};
+
+struct BlockEngine
+{
+    FragmentParser parser;
+    ParserState state;
+    BlockStats stats;
+    BlockMemo* memo = nullptr;
+    bool recordLocations = false;
+    std::vector<BlockLocation> locations; // blocks of the current document
+    std::string projected; // block under --columns, unwanted data cut out
+
+    BlockEngine() { state.out = nullptr; }
+
+    void processBlock(std::string_view block, std::ostream& out);
+
+    // Parse the blocks that start in [start, to). start must be the begin
+    // of a block (or npos for none). Returns the begin of the first block
+    // at or past to, npos when there is none.
+    std::size_t processRange(std::string_view doc,
+                             std::size_t start,
+                             std::size_t to,
+                             std::ostream& out);
+
+    // Parse a document header and write its publicationTime line
+    void processHeader(std::string_view header, std::ostream& out);
+};
+
+// Parse one document held in memory block by block, on engines.size()
+// threads
+void processDocument(std::string_view doc,
+                     std::vector<BlockEngine>& engines,
+                     BlockMemo* memo,
+                     std::ostream& out);
+
+// Identity of a publication, taken from the document header
+struct PublicationKey
+{
+    std::string publicationTime;
+    std::string tableVersion; // measurementSiteTableReference version
+
+    [[nodiscard]] bool empty() const { return publicationTime.empty(); }
+};
+
+// Bytes at the start of a document that hold the publication key
+constexpr std::size_t publicationHeadSize = 16 * 1024;
+
+// Extract the publication key from the start of a document by plain text
+// search; false when publicationTime is not in head
+bool scanPublicationKey(std::string_view head, PublicationKey& key);
+
+// Persistent set of processed publications, one "time version" line each
+class PublicationIndex
+{
+  public:
+    // Load the entries of path; a missing file is an empty index
+    bool open(const std::string& path);
+
+    [[nodiscard]] bool contains(const PublicationKey& key) const;
+
+    // Record a processed publication and append it to the file
+    bool add(const PublicationKey& key);
+
+  private:
+    std::string path_;
+    std::unordered_set<std::string> entries_;
+};
+
+// Block parse of a document that arrives in chunks: each block is parsed
+// and written as soon as its end tag has arrived
+class IncrementalDocument
+{
+  public:
+    // Called with the publication key once the header is complete; the
+    // document is skipped when it returns false
+    using HeaderCheck = std::function<bool(const PublicationKey&)>;
+
+    IncrementalDocument(BlockEngine& engine, std::ostream& out)
+        : engine_(engine), out_(out)
+    {
+    }
+
+    void setHeaderCheck(HeaderCheck check) { check_ = std::move(check); }
+
+    void feed(std::string_view chunk);
+
+    // End of input: a document without blocks still has its header
+    void finish();
+
+    // True once the closing tag of the root element has been seen
+    [[nodiscard]] bool complete() const { return complete_; }
+
+    // True when the header check rejected the document
+    [[nodiscard]] bool skipped() const { return skipped_; }
+
+  private:
+    void parseHeader(std::size_t end);
+
+    BlockEngine& engine_;
+    std::ostream& out_;
+    HeaderCheck check_;
+    std::string pending_;
+    std::size_t pos_ = 0;
+    std::string rootClose_;
+    bool headerDone_ = false;
+    bool complete_ = false;
+    bool skipped_ = false;
+};
+
+// Replace directory arguments by the feeds they contain, in name order, so a
+// whole archive directory is one batch. Only *.xml files and packed files
+// are taken, not the sidecar indexes, temporary files or dedup index that
+// may sit next to them.
+std::vector<std::string> expandInputs(const std::vector<std::string>& args);
@@ -0,0 +1,166 @@
+#include "health.hpp"
+#include "records.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+constexpr std::size_t bucketWays = 4;
+constexpr std::string_view healthMagic = "XDH1";
+constexpr std::uint64_t healthMix = 0x9E3779B97F4A7C15ULL;
+
+std::string_view healthEventName(HealthEvent event)
+{
+    switch (event)
+    {
+    case HealthEvent::None:
+        break;
+    case HealthEvent::Missing:
+        return "missing";
+    case HealthEvent::Stuck:
+        return "stuck";
+    case HealthEvent::Implausible:
+        return "implausible";
+    case HealthEvent::Recovered:
+        return "recovered";
+    }
+    return "ok";
+}
+
+DetectorHealth::DetectorHealth(std::size_t capacity, HealthLimits limits)
+    : limits_(limits)
+{
+    std::size_t buckets = 1;
+    while (buckets * bucketWays < capacity)
+    {
+        buckets *= 2;
+    }
+    owned_.resize(buckets * bucketWays);
+    entries_ = owned_;
+    bucketMask_ = buckets - 1;
+}
+
+bool DetectorHealth::open(const std::string& path)
+{
+    static_assert(std::is_trivially_copyable_v<Entry>);
+    if (!state_.open(path, healthMagic, sizeof(Entry), entries_.size()))
+    {
+        return false;
+    }
+    entries_ = {static_cast<Entry*>(state_.entries()), entries_.size()};
+    owned_.clear();
+    owned_.shrink_to_fit();
+    publication_ = state_.publication();
+    return true;
+}
+
+// Entry of key, taking over a free or the least recently seen entry of its
+// bucket when key is new
+DetectorHealth::Entry& DetectorHealth::entry(std::uint64_t key)
+{
+    std::uint64_t hash = key * healthMix;
+    hash ^= hash >> 32U;
+    const std::size_t base =
+        (static_cast<std::size_t>(hash) & bucketMask_) * bucketWays;
+    Entry* victim = &entries_[base];
+    for (std::size_t way = 0; way < bucketWays; ++way)
+    {
+        Entry& candidate = entries_[base + way];
+        if (candidate.key == key)
+        {
+            return candidate;
+        }
+        if (candidate.key == 0)
+        {
+            victim = &candidate;
+            break;
+        }
+        if (candidate.lastSeen < victim->lastSeen)
+        {
+            victim = &candidate;
+        }
+    }
+    *victim = Entry();
+    victim->key = key;
+    victim->since = publication_;
+    return *victim;
+}
+
+HealthEvent DetectorHealth::observe(SiteKey site,
+                                    std::uint32_t index,
+                                    double speed,
+                                    std::int64_t flow,
+                                    std::uint32_t& run)
+{
+    const std::uint64_t mixed = site * healthMix + index;
+    Entry& e = entry(mixed == 0 ? 1 : mixed);
+    e.lastSeen = publication_;
+
+    const bool missing = speed < 0;
+    const bool implausible =
+        !missing && (speed > limits_.maxSpeed || flow > limits_.maxFlow ||
+                     (speed > 0 && flow == 0) || (speed == 0 && flow > 0));
+    const auto narrowSpeed = static_cast<float>(speed);
+    const auto narrowFlow = static_cast<std::int32_t>(
+        std::clamp<std::int64_t>(flow,
+                                 std::numeric_limits<std::int32_t>::min(),
+                                 std::numeric_limits<std::int32_t>::max()));
+    const bool same = !missing && flow > 0 && e.sameRun > 0 &&
+                      narrowSpeed == e.speed && narrowFlow == e.flow;
+    e.missingRun = missing ? e.missingRun + 1 : 0;
+    e.badRun = implausible ? e.badRun + 1 : 0;
+    e.sameRun = missing ? 0 : (same ? e.sameRun + 1 : 1);
+    e.speed = narrowSpeed;
+    e.flow = narrowFlow;
+
+    HealthEvent next = e.state;
+    if (e.missingRun >= limits_.missingRun)
+    {
+        next = HealthEvent::Missing;
+        run = e.missingRun;
+    }
+    else if (e.sameRun >= limits_.stuckRun)
+    {
+        next = HealthEvent::Stuck;
+        run = e.sameRun;
+    }
+    else if (e.badRun >= limits_.implausibleRun)
+    {
+        next = HealthEvent::Implausible;
+        run = e.badRun;
+    }
+    else if (!missing && !implausible && !same)
+    {
+        next = HealthEvent::None;
+        run = publication_ - e.since;
+    }
+
+    if (next == e.state)
+    {
+        return HealthEvent::None;
+    }
+    e.state = next;
+    e.since = publication_;
+    return next == HealthEvent::None ? HealthEvent::Recovered : next;
+}
+
+void DetectorHealth::update(const RecordBatch& batch, std::ostream& out)
+{
+    ++publication_;
+    if (state_.mapped())
+    {
+        state_.publication() = publication_;
+    }
+    for (std::size_t i = 0; i < batch.size(); ++i)
+    {
+        std::uint32_t run = 0;
+        const HealthEvent event = observe(
+            batch.site[i], batch.index[i], batch.speed[i], batch.flow[i], run);
+        if (event != HealthEvent::None)
+        {
+            out << formatIsoTime(batch.time[i]) << ' '
+                << batch.siteId(batch.site[i]) << ' ' << batch.index[i] << ' '
+                << healthEventName(event) << ' ' << run << '\n';
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "sitekey.hpp"
+#include "trackerstate.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class RecordBatch;
+
+// Detector health tracked across consecutive publications, one entry per
+// (site, index) in a fixed-size table (4-way buckets; the entry seen
+// longest ago is replaced when a bucket is full), so every record costs
+// O(1) and memory does not grow with the number of detectors.
+//
+// A detector is
+//   missing     after missingRun publications without a speed (-1, which
+//               the feed sends with numberOfInputValuesUsed="0"),
+//   stuck       after stuckRun publications with the same nonzero flow and
+//               speed,
+//   implausible after implausibleRun publications of a speed above
+//               maxSpeed, a flow above maxFlow, a speed without flow or a
+//               zero speed with flow,
+// and recovered on its first good record after any of these. Each change
+// is written as one line: time site index event run, where run counts the
+// publications that led to it (for recovered: publications since the
+// fault was reported). The table lives in memory, or with open() in a
+// state file that keeps the runs across processes.
+
+enum class HealthEvent : std::uint8_t
+{
+    None,
+    Missing,
+    Stuck,
+    Implausible,
+    Recovered
+};
+
+std::string_view healthEventName(HealthEvent event);
+
+struct HealthLimits
+{
+    std::uint32_t missingRun = 60;
+    std::uint32_t stuckRun = 30;
+    std::uint32_t implausibleRun = 5;
+    double maxSpeed = 250;
+    std::int64_t maxFlow = 10000;
+};
+
+class DetectorHealth
+{
+  public:
+    static constexpr std::size_t defaultCapacity = std::size_t{1} << 18U;
+
+    explicit DetectorHealth(std::size_t capacity = defaultCapacity,
+                            HealthLimits limits = {});
+
+    // Keep the table in a state file, created empty when missing; false
+    // when it cannot be mapped or holds another table
+    bool open(const std::string& path);
+
+    // Track one record; returns the event it causes, with the run length
+    HealthEvent observe(SiteKey site,
+                        std::uint32_t index,
+                        double speed,
+                        std::int64_t flow,
+                        std::uint32_t& run);
+
+    // Track every row of one publication and write its events to out
+    void update(const RecordBatch& batch, std::ostream& out);
+
+  private:
+    struct Entry
+    {
+        std::uint64_t key = 0; // 0: free
+        float speed = 0;
+        std::int32_t flow = 0;
+        std::uint32_t sameRun = 0;
+        std::uint32_t missingRun = 0;
+        std::uint32_t badRun = 0;
+        std::uint32_t lastSeen = 0;
+        std::uint32_t since = 0; // publication the state began
+        HealthEvent state = HealthEvent::None;
+    };
+
+    Entry& entry(std::uint64_t key);
+
+    HealthLimits limits_;
+    std::vector<Entry> owned_;
+    std::span<Entry> entries_;
+    std::size_t bucketMask_;
+    std::uint32_t publication_ = 0;
+    TrackerState state_;
+};
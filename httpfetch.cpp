@@ -0,0 +1,83 @@
+#include "httpfetch.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <utility>
+
+bool PollState::load(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        const std::size_t space = line.find(' ');
+        if (space == std::string::npos)
+        {
+            continue;
+        }
+        const std::string_view key = std::string_view(line).substr(0, space);
+        std::string value = line.substr(space + 1);
+        if (key == "etag")
+        {
+            etag = std::move(value);
+        }
+        else if (key == "last-modified")
+        {
+            lastModified = std::move(value);
+        }
+        else if (key == "publication-time")
+        {
+            publicationTime = std::move(value);
+        }
+    }
+    return true;
+}
+
+bool PollState::save(const std::string& path) const
+{
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << "etag " << etag << '\n'
+            << "last-modified " << lastModified << '\n'
+            << "publication-time " << publicationTime << '\n';
+        if (!out.flush())
+        {
+            return false;
+        }
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+std::string headerValue(std::string_view line, std::string_view name)
+{
+    if (line.size() <= name.size() + 1 || line[name.size()] != ':')
+    {
+        return {};
+    }
+    const auto lower = [](char chr)
+    {
+        constexpr char caseBit = 'a' - 'A';
+        return (chr >= 'A' && chr <= 'Z') ? static_cast<char>(chr + caseBit)
+                                          : chr;
+    };
+    for (std::size_t i = 0; i < name.size(); ++i)
+    {
+        if (lower(line[i]) != name[i])
+        {
+            return {};
+        }
+    }
+    line.remove_prefix(name.size() + 1);
+    const std::size_t begin = line.find_first_not_of(" \t");
+    const std::size_t end = line.find_last_not_of(" \t\r\n");
+    if (begin == std::string_view::npos)
+    {
+        return {};
+    }
+    return std::string(line.substr(begin, end - begin + 1));
+}
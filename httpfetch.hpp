@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+
+// HTTP feed helpers shared by xmlpoll and xmlingest: conditional-fetch
+// state, a streaming gzip decoder and response header parsing.
+
+// Validators and last processed publication, kept between polls and runs
+struct PollState
+{
+    std::string etag;
+    std::string lastModified;
+    std::string publicationTime;
+
+    bool load(const std::string& path);
+
+    // Write to a temporary file and rename, so a crash never truncates it
+    bool save(const std::string& path) const;
+};
+
+// Streaming gzip/zlib decoder; bodies without a gzip header pass through
+class Inflater
+{
+  public:
+    Inflater() = default;
+
+    ~Inflater()
+    {
+        if (active_)
+        {
+            (void)inflateEnd(&stream_);
+        }
+    }
+
+    Inflater(const Inflater&) = delete;
+    Inflater& operator=(const Inflater&) = delete;
+    Inflater(Inflater&&) = delete;
+    Inflater& operator=(Inflater&&) = delete;
+
+    // Decode chunk and hand the output to sink. Returns false on bad data.
+    template <typename Sink> bool write(std::string_view chunk, Sink&& sink)
+    {
+        if (!detected_ && !chunk.empty())
+        {
+            detected_ = true;
+            constexpr unsigned char gzipMagic = 0x1f;
+            if (static_cast<unsigned char>(chunk.front()) == gzipMagic)
+            {
+                // 15 window bits plus 32: accept both gzip and zlib headers
+                constexpr int windowBits = 15 + 32;
+                active_ = inflateInit2(&stream_, windowBits) == Z_OK;
+                if (!active_)
+                {
+                    return false;
+                }
+            }
+        }
+        if (!active_)
+        {
+            sink(chunk);
+            return true;
+        }
+
+        // NOLINTBEGIN[cppcoreguidelines-pro-type-reinterpret-cast]
+        stream_.next_in = reinterpret_cast<Bytef*>(
+            const_cast<char*>(chunk.data())); // NOLINT
+        // NOLINTEND[cppcoreguidelines-pro-type-reinterpret-cast]
+        stream_.avail_in = static_cast<uInt>(chunk.size());
+        while (stream_.avail_in > 0)
+        {
+            // NOLINTBEGIN[cppcoreguidelines-pro-type-reinterpret-cast]
+            stream_.next_out = reinterpret_cast<Bytef*>(buffer_.data());
+            // NOLINTEND[cppcoreguidelines-pro-type-reinterpret-cast]
+            stream_.avail_out = static_cast<uInt>(buffer_.size());
+            const int ret = inflate(&stream_, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+            {
+                return false;
+            }
+            sink(std::string_view(buffer_.data(),
+                                  buffer_.size() - stream_.avail_out));
+            if (ret == Z_STREAM_END)
+            {
+                // Concatenated gzip members continue with a fresh header
+                (void)inflateReset(&stream_);
+            }
+            else if (ret == Z_BUF_ERROR)
+            {
+                break;
+            }
+        }
+        return true;
+    }
+
+  private:
+    static constexpr std::size_t bufferSize = 256 * 1024;
+
+    z_stream stream_ = {};
+    std::vector<char> buffer_ = std::vector<char>(bufferSize);
+    bool detected_ = false;
+    bool active_ = false;
+};
+
+// Value of header line if it is the named header, empty otherwise
+std::string headerValue(std::string_view line, std::string_view name);
@@ -0,0 +1,254 @@
+#include "impute.hpp"
+#include "extractor.hpp"
+#include "feedparser.hpp"
+#include "records.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <libxml/parser.h>
+#include <sstream>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+constexpr std::size_t bucketWays = 4;
+constexpr std::uint64_t imputeMix = 0x9E3779B97F4A7C15ULL;
+constexpr std::string_view imputeMagic = "XSI1";
+
+using SiteNames =
+    Extractor<"measurementSiteRecord",
+              Field<"measurementSiteRecord", std::string, "id">,
+              Field<"measurementSiteName", std::string>>;
+
+struct RoadPost
+{
+    std::string road; // road and carriageway
+    double km;
+    SiteKey site;
+};
+
+// Split "N457 hmp 4.75 Re" into road "N457 Re" and post 4.75
+static bool parseRoadPost(const std::string& name, RoadPost& post)
+{
+    std::istringstream in(name);
+    std::string road;
+    std::string marker;
+    double km = 0;
+    if (!(in >> road >> marker >> km) || marker != "hmp")
+    {
+        return false;
+    }
+    std::string side;
+    std::getline(in >> std::ws, side);
+    post.road = road + ' ' + side;
+    post.km = km;
+    return true;
+}
+
+SpeedImputer::SpeedImputer(std::size_t capacity, ImputeLimits limits)
+    : limits_(limits)
+{
+    std::size_t buckets = 1;
+    while (buckets * bucketWays < capacity)
+    {
+        buckets *= 2;
+    }
+    owned_.resize(buckets * bucketWays);
+    entries_ = owned_;
+    bucketMask_ = buckets - 1;
+}
+
+bool SpeedImputer::open(const std::string& path)
+{
+    static_assert(std::is_trivially_copyable_v<Entry>);
+    if (!state_.open(path, imputeMagic, sizeof(Entry), entries_.size()))
+    {
+        return false;
+    }
+    entries_ = {static_cast<Entry*>(state_.entries()), entries_.size()};
+    owned_.clear();
+    owned_.shrink_to_fit();
+    publication_ = state_.publication();
+    return true;
+}
+
+bool SpeedImputer::loadNeighbours(const std::string& path)
+{
+    xmlTextReaderPtr reader =
+        xmlReaderForFile(path.c_str(), nullptr, xmlReaderOptions());
+    if (reader == nullptr)
+    {
+        return false;
+    }
+    std::vector<RoadPost> posts;
+    SiteNames names;
+    const int status = names.run(
+        reader,
+        [&posts](const SiteNames::Values& values)
+        {
+            const auto& [id, name] = values;
+            RoadPost post;
+            if (!id.empty() && parseRoadPost(name, post))
+            {
+                post.site = recordSiteKey(id);
+                posts.push_back(std::move(post));
+            }
+        });
+    xmlFreeTextReader(reader);
+    if (status != 0)
+    {
+        return false;
+    }
+
+    std::ranges::sort(posts,
+                      [](const RoadPost& a, const RoadPost& b)
+                      { return std::tie(a.road, a.km) < std::tie(b.road, b.km); });
+    for (std::size_t i = 1; i < posts.size(); ++i)
+    {
+        const RoadPost& lower = posts[i - 1];
+        const RoadPost& higher = posts[i];
+        if (lower.road == higher.road &&
+            higher.km - lower.km <= limits_.maxNeighbourKm)
+        {
+            neighbours_[lower.site].next = higher.site;
+            neighbours_[higher.site].previous = lower.site;
+        }
+    }
+    return true;
+}
+
+SpeedImputer::Entry& SpeedImputer::entry(std::uint64_t key)
+{
+    std::uint64_t hash = key * imputeMix;
+    hash ^= hash >> 32U;
+    const std::size_t base =
+        (static_cast<std::size_t>(hash) & bucketMask_) * bucketWays;
+    Entry* victim = &entries_[base];
+    for (std::size_t way = 0; way < bucketWays; ++way)
+    {
+        Entry& candidate = entries_[base + way];
+        if (candidate.key == key)
+        {
+            return candidate;
+        }
+        if (candidate.key == 0)
+        {
+            victim = &candidate;
+            break;
+        }
+        if (candidate.lastSeen < victim->lastSeen)
+        {
+            victim = &candidate;
+        }
+    }
+    *victim = Entry();
+    victim->key = key;
+    return *victim;
+}
+
+// Mean measured speed of the neighbours of site; NaN when none reported one
+float SpeedImputer::neighbourMean(SiteKey site) const
+{
+    const auto found = neighbours_.find(site);
+    if (found == neighbours_.end())
+    {
+        return NAN;
+    }
+    float sum = 0;
+    int count = 0;
+    for (const SiteKey neighbour : {found->second.previous, found->second.next})
+    {
+        const auto mean = siteMeans_.find(neighbour);
+        if (neighbour != 0 && mean != siteMeans_.end())
+        {
+            sum += mean->second;
+            ++count;
+        }
+    }
+    return count == 0 ? NAN : sum / static_cast<float>(count);
+}
+
+void SpeedImputer::update(RecordBatch& batch, std::vector<char>& sources)
+{
+    ++publication_;
+    if (state_.mapped())
+    {
+        state_.publication() = publication_;
+    }
+    const std::size_t rows = batch.size();
+    sources.assign(rows, 'm');
+
+    // Mean measured speed of every block, per row and (for the neighbours
+    // of other sites) per site
+    rowMeans_.assign(rows, NAN);
+    siteMeans_.clear();
+    for (std::size_t begin = 0; begin < rows;)
+    {
+        std::size_t end = begin + 1;
+        while (end < rows && batch.site[end] == batch.site[begin])
+        {
+            ++end;
+        }
+        double sum = 0;
+        std::size_t count = 0;
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            if (batch.speed[i] >= 0)
+            {
+                sum += batch.speed[i];
+                ++count;
+            }
+        }
+        if (count > 0)
+        {
+            const auto mean =
+                static_cast<float>(sum / static_cast<double>(count));
+            std::fill(rowMeans_.begin() + static_cast<std::ptrdiff_t>(begin),
+                      rowMeans_.begin() + static_cast<std::ptrdiff_t>(end),
+                      mean);
+            if (!neighbours_.empty())
+            {
+                siteMeans_[batch.site[begin]] = mean;
+            }
+        }
+        begin = end;
+    }
+
+    for (std::size_t i = 0; i < rows; ++i)
+    {
+        const std::uint64_t mixed = batch.site[i] * imputeMix + batch.index[i];
+        Entry& e = entry(mixed == 0 ? 1 : mixed);
+        e.lastSeen = publication_;
+        const float siteMean = rowMeans_[i];
+        if (batch.speed[i] >= 0)
+        {
+            e.speed = static_cast<float>(batch.speed[i]);
+            e.lastValid = publication_;
+            if (siteMean > 0)
+            {
+                e.ratio += limits_.ratioWeight * (e.speed / siteMean - e.ratio);
+            }
+            continue;
+        }
+        if (e.speed >= 0 && publication_ - e.lastValid <= limits_.historyRun)
+        {
+            batch.speed[i] = e.speed;
+            sources[i] = 'h';
+        }
+        else if (!std::isnan(siteMean))
+        {
+            batch.speed[i] = siteMean * e.ratio;
+            sources[i] = 'l';
+        }
+        else if (const float near = neighbourMean(batch.site[i]);
+                 !std::isnan(near))
+        {
+            batch.speed[i] = near * e.ratio;
+            sources[i] = 'n';
+        }
+        else
+        {
+            sources[i] = '-';
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "sitekey.hpp"
+#include "trackerstate.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class RecordBatch;
+
+// Fills missing speeds (-1) of one publication in place, in order of
+// confidence, from
+//   h  the last measured speed of the same detector (site, index), at most
+//      historyRun publications old,
+//   l  the mean measured speed of the other lanes and classes of the same
+//      site in this publication, scaled by the detector's usual ratio to
+//      that mean,
+//   n  the mean measured speed of the upstream and downstream neighbours
+//      of the site in this publication, scaled the same way.
+// Measured speeds are flagged m, speeds that stay missing -. Detectors are
+// kept in a fixed-size table of 4-way buckets like DetectorHealth, in memory
+// or, with open(), in a state file so that h reaches across processes.
+//
+// Neighbours come from a measurement site table: sites named like
+// "N457 hmp 4.75 Re" (road, hectometre post in km, carriageway) are ordered
+// along their road and carriageway, and the nearest sites within
+// maxNeighbourKm on either side are neighbours.
+
+struct ImputeLimits
+{
+    std::uint32_t historyRun = 5;
+    double maxNeighbourKm = 2;
+    float ratioWeight = 1.0F / 16; // of a new observation in the lane ratio
+};
+
+class SpeedImputer
+{
+  public:
+    static constexpr std::size_t defaultCapacity = std::size_t{1} << 18U;
+
+    explicit SpeedImputer(std::size_t capacity = defaultCapacity,
+                          ImputeLimits limits = {});
+
+    // Keep the detector table in a state file, created empty when missing;
+    // false when it cannot be mapped or holds another table
+    bool open(const std::string& path);
+
+    // Read neighbours from a site table; false when it cannot be parsed
+    bool loadNeighbours(const std::string& path);
+
+    [[nodiscard]] std::size_t neighbourSites() const
+    {
+        return neighbours_.size();
+    }
+
+    // Fill the missing speeds of batch, whose blocks must be contiguous;
+    // sources gets one flag (m, h, l, n or -) per row
+    void update(RecordBatch& batch, std::vector<char>& sources);
+
+  private:
+    struct Entry
+    {
+        std::uint64_t key = 0; // 0: free
+        float speed = -1;      // last measured speed
+        float ratio = 1;       // usual speed / site mean
+        std::uint32_t lastSeen = 0;
+        std::uint32_t lastValid = 0;
+    };
+
+    struct Neighbours
+    {
+        SiteKey previous = 0; // lower hectometre post, 0: none
+        SiteKey next = 0;
+    };
+
+    Entry& entry(std::uint64_t key);
+    [[nodiscard]] float neighbourMean(SiteKey site) const;
+
+    ImputeLimits limits_;
+    std::vector<Entry> owned_;
+    std::span<Entry> entries_;
+    std::size_t bucketMask_;
+    std::uint32_t publication_ = 0;
+    TrackerState state_;
+    std::unordered_map<SiteKey, Neighbours> neighbours_;
+    // Per publication, kept to reuse their storage
+    std::unordered_map<SiteKey, float> siteMeans_;
+    std::vector<float> rowMeans_;
+};
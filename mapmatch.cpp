@@ -0,0 +1,479 @@
+#include "mapmatch.hpp"
+#include "records.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <numbers>
+#include <sstream>
+
+constexpr double earthRadius = 6371000; // metres
+constexpr double cellDegrees = 0.005;
+constexpr int unknownFrc = 7;
+constexpr double frcCost = 0.25; // per class of difference
+
+static double radians(double degrees)
+{
+    return degrees * std::numbers::pi / 180;
+}
+
+// Offset of (lat, lon) from (lat0, lon0) in metres east and north, fine
+// for the few hundred metres a match looks at
+static void localOffset(
+    double lat0, double lon0, double lat, double lon, double& x, double& y)
+{
+    x = radians(lon - lon0) * earthRadius * std::cos(radians(lat0));
+    y = radians(lat - lat0) * earthRadius;
+}
+
+static double heading(double x, double y)
+{
+    const double degrees = std::atan2(x, y) * 180 / std::numbers::pi;
+    return degrees < 0 ? degrees + 360 : degrees;
+}
+
+static double bearingDiff(double a, double b)
+{
+    const double diff = std::fabs(std::fmod(a - b, 360.0));
+    return diff > 180 ? 360 - diff : diff;
+}
+
+static bool readText(xmlTextReaderPtr reader, std::string& out)
+{
+    xmlChar* text = xmlTextReaderReadString(reader);
+    if (text == nullptr)
+    {
+        out.clear();
+        return false;
+    }
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    out = reinterpret_cast<const char*>(text);
+    xmlFree(text);
+    return true;
+}
+
+static bool readDouble(xmlTextReaderPtr reader, double& out)
+{
+    std::string text;
+    if (!readText(reader, text))
+    {
+        return false;
+    }
+    char* end = nullptr;
+    const double value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str())
+    {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+static std::string readAttribute(xmlTextReaderPtr reader, const char* name)
+{
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    xmlChar* text = xmlTextReaderGetAttribute(
+        reader, reinterpret_cast<const xmlChar*>(name));
+    if (text == nullptr)
+    {
+        return {};
+    }
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    std::string value(reinterpret_cast<const char*>(text));
+    xmlFree(text);
+    return value;
+}
+
+// OpenLR fields of one site record
+struct OpenLrPoint
+{
+    double lat = NAN;
+    double lon = NAN;
+    double lastLat = NAN;
+    double lastLon = NAN;
+    double displayLat = NAN;
+    double displayLon = NAN;
+    double bearing = NAN;
+    double offset = 0;
+    int frc = unknownFrc;
+
+    [[nodiscard]] bool place(SitePoint& point) const
+    {
+        if (std::isnan(lat) || std::isnan(lon))
+        {
+            if (std::isnan(displayLat) || std::isnan(displayLon))
+            {
+                return false;
+            }
+            point = SitePoint{displayLat, displayLon, NAN, frc};
+            return true;
+        }
+        point = SitePoint{lat, lon, bearing, frc};
+        if (std::isnan(lastLat) || std::isnan(lastLon))
+        {
+            return true;
+        }
+        double x = 0;
+        double y = 0;
+        localOffset(lat, lon, lastLat, lastLon, x, y);
+        const double length = std::hypot(x, y);
+        if (length > 0)
+        {
+            point.bearing = heading(x, y);
+            const double along = std::clamp(offset / length, 0.0, 1.0);
+            point.lat = lat + (lastLat - lat) * along;
+            point.lon = lon + (lastLon - lon) * along;
+        }
+        return true;
+    }
+};
+
+bool readSitePlacements(xmlTextReaderPtr reader,
+                        std::vector<SitePlacement>& sites)
+{
+    sites.clear();
+    OpenLrPoint openlr;
+    enum
+    {
+        Outside,
+        Display,
+        First,
+        Last
+    } where = Outside;
+    std::string text;
+    int status = 0;
+    while ((status = xmlTextReaderRead(reader)) == 1)
+    {
+        const int nodeType = xmlTextReaderNodeType(reader);
+        if (nodeType != XML_READER_TYPE_ELEMENT &&
+            nodeType != XML_READER_TYPE_END_ELEMENT)
+        {
+            continue;
+        }
+        // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+        const auto* local = reinterpret_cast<const char*>(
+            xmlTextReaderConstLocalName(reader));
+        if (local == nullptr)
+        {
+            continue;
+        }
+        const std::string_view name(local);
+        if (nodeType == XML_READER_TYPE_END_ELEMENT)
+        {
+            if (name == "measurementSiteRecord" && !sites.empty())
+            {
+                sites.back().placed = openlr.place(sites.back().point);
+            }
+            else if (name == "locationForDisplay" ||
+                     name == "openlrLocationReferencePoint" ||
+                     name == "openlrLastLocationReferencePoint")
+            {
+                where = Outside;
+            }
+            continue;
+        }
+
+        if (name == "measurementSiteRecord")
+        {
+            sites.push_back(SitePlacement{readAttribute(reader, "id"),
+                                          readAttribute(reader, "version")});
+            openlr = OpenLrPoint();
+        }
+        else if (name == "locationForDisplay")
+        {
+            where = Display;
+        }
+        else if (name == "openlrLocationReferencePoint")
+        {
+            where = First;
+        }
+        else if (name == "openlrLastLocationReferencePoint")
+        {
+            where = Last;
+        }
+        else if (name == "latitude" || name == "longitude")
+        {
+            const bool latitude = name == "latitude";
+            double* slot = nullptr;
+            switch (where)
+            {
+            case Outside:
+                break;
+            case Display:
+                slot = latitude ? &openlr.displayLat : &openlr.displayLon;
+                break;
+            case First:
+                slot = latitude ? &openlr.lat : &openlr.lon;
+                break;
+            case Last:
+                slot = latitude ? &openlr.lastLat : &openlr.lastLon;
+                break;
+            }
+            if (slot != nullptr)
+            {
+                (void)readDouble(reader, *slot);
+            }
+        }
+        else if (name == "openlrBearing" && where == First)
+        {
+            (void)readDouble(reader, openlr.bearing);
+        }
+        else if (name == "openlrFunctionalRoadClass" && where == First)
+        {
+            // FRC0 .. FRC7
+            if (readText(reader, text) && text.size() == 4 &&
+                text.starts_with("FRC") && text[3] >= '0' && text[3] <= '7')
+            {
+                openlr.frc = text[3] - '0';
+            }
+        }
+        else if (name == "openlrPositiveOffset")
+        {
+            (void)readDouble(reader, openlr.offset);
+        }
+    }
+    return status == 0;
+}
+
+std::uint64_t RoadGraph::cell(double lat, double lon)
+{
+    const auto row = static_cast<std::int32_t>(std::floor(lat / cellDegrees));
+    const auto column =
+        static_cast<std::int32_t>(std::floor(lon / cellDegrees));
+    return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(row)) << 32U) |
+           static_cast<std::uint32_t>(column);
+}
+
+bool RoadGraph::load(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        RoadSegment segment{};
+        std::string value;
+        if (line.empty() || line.front() == '#' ||
+            !std::getline(fields, segment.id, ','))
+        {
+            continue;
+        }
+        std::vector<double> numbers;
+        while (std::getline(fields, value, ','))
+        {
+            char* end = nullptr;
+            numbers.push_back(std::strtod(value.c_str(), &end));
+            if (end == value.c_str())
+            {
+                numbers.clear();
+                break;
+            }
+        }
+        // Header lines and malformed lines have no coordinates
+        const std::size_t coordinates = 4;
+        if (numbers.size() < coordinates)
+        {
+            continue;
+        }
+        segment.lat1 = numbers[0];
+        segment.lon1 = numbers[1];
+        segment.lat2 = numbers[2];
+        segment.lon2 = numbers[3];
+        segment.frc = numbers.size() > coordinates
+                          ? static_cast<int>(numbers[coordinates])
+                          : unknownFrc;
+
+        const auto number = static_cast<std::uint32_t>(segments_.size());
+        segments_.push_back(std::move(segment));
+        const RoadSegment& s = segments_.back();
+        const auto row0 = std::floor(std::min(s.lat1, s.lat2) / cellDegrees);
+        const auto row1 = std::floor(std::max(s.lat1, s.lat2) / cellDegrees);
+        const auto col0 = std::floor(std::min(s.lon1, s.lon2) / cellDegrees);
+        const auto col1 = std::floor(std::max(s.lon1, s.lon2) / cellDegrees);
+        for (double row = row0; row <= row1; ++row)
+        {
+            for (double col = col0; col <= col1; ++col)
+            {
+                cells_[cell((row + 0.5) * cellDegrees, (col + 0.5) * cellDegrees)]
+                    .push_back(number);
+            }
+        }
+    }
+    return !in.bad();
+}
+
+std::int64_t RoadGraph::match(const SitePoint& point, MatchLimits limits) const
+{
+    std::int64_t best = -1;
+    double bestCost = 0;
+    std::vector<std::uint32_t> seen;
+    for (int dlat = -1; dlat <= 1; ++dlat)
+    {
+        for (int dlon = -1; dlon <= 1; ++dlon)
+        {
+            const auto found = cells_.find(cell(point.lat + dlat * cellDegrees,
+                                                point.lon + dlon * cellDegrees));
+            if (found == cells_.end())
+            {
+                continue;
+            }
+            for (const std::uint32_t number : found->second)
+            {
+                if (std::ranges::find(seen, number) != seen.end())
+                {
+                    continue;
+                }
+                seen.push_back(number);
+                const RoadSegment& s = segments_[number];
+
+                // Distance from the point to the segment in local metres
+                double x1 = 0;
+                double y1 = 0;
+                double x2 = 0;
+                double y2 = 0;
+                localOffset(point.lat, point.lon, s.lat1, s.lon1, x1, y1);
+                localOffset(point.lat, point.lon, s.lat2, s.lon2, x2, y2);
+                const double dx = x2 - x1;
+                const double dy = y2 - y1;
+                const double squared = dx * dx + dy * dy;
+                const double along =
+                    squared > 0
+                        ? std::clamp(-(x1 * dx + y1 * dy) / squared, 0.0, 1.0)
+                        : 0.0;
+                const double distance =
+                    std::hypot(x1 + along * dx, y1 + along * dy);
+                if (distance > limits.matchRadius)
+                {
+                    continue;
+                }
+                double turn = 0;
+                if (!std::isnan(point.bearing) && squared > 0)
+                {
+                    turn = bearingDiff(heading(dx, dy), point.bearing);
+                    if (turn > limits.maxBearingDiff)
+                    {
+                        continue;
+                    }
+                }
+                const double cost = distance / limits.matchRadius +
+                                    turn / limits.maxBearingDiff +
+                                    frcCost * std::abs(s.frc - point.frc);
+                if (best < 0 || cost < bestCost)
+                {
+                    best = number;
+                    bestCost = cost;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+bool readMatchCache(const std::string& path,
+                    std::unordered_map<std::string, SiteMatch>& matches)
+{
+    std::ifstream in(path);
+    std::string magic;
+    if (!in || !std::getline(in, magic) || magic != matchMagic)
+    {
+        return false;
+    }
+    std::string id;
+    SiteMatch match;
+    while (in >> id >> match.version >> match.segment)
+    {
+        matches[id] = match;
+    }
+    return in.eof();
+}
+
+bool writeMatchCache(const std::string& path,
+                     const std::unordered_map<std::string, SiteMatch>& matches)
+{
+    std::vector<const std::pair<const std::string, SiteMatch>*> sorted;
+    sorted.reserve(matches.size());
+    for (const auto& entry : matches)
+    {
+        sorted.push_back(&entry);
+    }
+    std::ranges::sort(sorted,
+                      [](const auto* a, const auto* b)
+                      { return a->first < b->first; });
+
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << matchMagic << '\n';
+        for (const auto* entry : sorted)
+        {
+            out << entry->first << ' ' << entry->second.version << ' '
+                << entry->second.segment << '\n';
+        }
+        if (!out.flush())
+        {
+            return false;
+        }
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool SegmentProjection::load(const std::string& cachePath)
+{
+    std::unordered_map<std::string, SiteMatch> matches;
+    if (!readMatchCache(cachePath, matches))
+    {
+        return false;
+    }
+    std::unordered_map<std::string, std::uint32_t> numbers;
+    for (const auto& [id, match] : matches)
+    {
+        if (match.segment == unmatchedSegment)
+        {
+            continue;
+        }
+        const auto [found, added] = numbers.try_emplace(
+            match.segment, static_cast<std::uint32_t>(names_.size()));
+        if (added)
+        {
+            names_.push_back(match.segment);
+        }
+        rows_[recordSiteKey(id)] = found->second;
+    }
+    sums_.assign(names_.size(), HarmonicSum{});
+    used_.assign(names_.size(), false);
+    return true;
+}
+
+void SegmentProjection::add(SiteKey site, const HarmonicSum& sum)
+{
+    const auto found = rows_.find(site);
+    if (found == rows_.end())
+    {
+        return;
+    }
+    const std::uint32_t row = found->second;
+    if (!used_[row])
+    {
+        used_[row] = true;
+        touched_.push_back(row);
+    }
+    sums_[row].add(sum);
+}
+
+void SegmentProjection::write(std::ostream& out)
+{
+    for (const std::uint32_t row : touched_)
+    {
+        out << names_[row] << ' ' << std::defaultfloat << sums_[row].speed()
+            << ' ' << sums_[row].flow << '\n';
+        sums_[row] = HarmonicSum{};
+        used_[row] = false;
+    }
+    touched_.clear();
+}
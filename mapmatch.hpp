@@ -0,0 +1,133 @@
+#pragma once
+
+#include "aggregate.hpp"
+#include "sitekey.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <libxml/xmlreader.h>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Map matching of measurement sites to directed road segments (xmlmatch)
+// and projection of site speeds onto them (xmline --match).
+//
+// Segments come from a CSV extract of the road graph, one directed segment
+// per line: id,lat1,lon1,lat2,lon2[,frc], with frc the functional road
+// class 0-7. A site is placed by its OpenLR point along line: the first
+// location reference point moved openlrPositiveOffset metres towards the
+// last one, heading from the first to the last point, with the FRC of the
+// first point. The segment with the lowest cost within matchRadius metres
+// and maxBearingDiff degrees of that heading wins.
+//
+// The match cache is a text file: matchMagic, then one line per site
+// "id version segment" (segment - when nothing matched). xmlmatch only
+// matches sites whose version is not in the cache yet.
+
+constexpr std::string_view matchMagic = "XMM1";
+constexpr std::string_view unmatchedSegment = "-";
+
+struct RoadSegment
+{
+    std::string id;
+    double lat1;
+    double lon1;
+    double lat2;
+    double lon2;
+    int frc;
+};
+
+// Where the site table places a site
+struct SitePoint
+{
+    double lat;
+    double lon;
+    double bearing; // degrees clockwise from north, NaN when unknown
+    int frc;        // 7 when unknown
+};
+
+struct SitePlacement
+{
+    std::string id;
+    std::string version;
+    SitePoint point{};
+    bool placed = false; // false without OpenLR or display coordinates
+};
+
+// Every measurementSiteRecord of a site table, placed by its OpenLR point
+// (or, lacking one, its locationForDisplay without a heading); false when
+// the table cannot be parsed to its end
+bool readSitePlacements(xmlTextReaderPtr reader,
+                        std::vector<SitePlacement>& sites);
+
+struct MatchLimits
+{
+    double matchRadius = 50;
+    double maxBearingDiff = 45;
+};
+
+class RoadGraph
+{
+  public:
+    // Read a segment CSV; false when it cannot be read
+    bool load(const std::string& path);
+
+    // Index of the best segment for point, -1 when none qualifies
+    [[nodiscard]] std::int64_t match(const SitePoint& point,
+                                     MatchLimits limits = {}) const;
+
+    [[nodiscard]] const RoadSegment& segment(std::size_t i) const
+    {
+        return segments_[i];
+    }
+
+    [[nodiscard]] std::size_t size() const { return segments_.size(); }
+
+  private:
+    [[nodiscard]] static std::uint64_t cell(double lat, double lon);
+
+    std::vector<RoadSegment> segments_;
+    // Segments by grid cell of about 500 m
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> cells_;
+};
+
+// Site id and version to segment id, as stored in the cache
+struct SiteMatch
+{
+    std::string version;
+    std::string segment; // unmatchedSegment when nothing matched
+};
+
+bool readMatchCache(const std::string& path,
+                    std::unordered_map<std::string, SiteMatch>& matches);
+
+// Written to a temporary file and renamed over path
+bool writeMatchCache(const std::string& path,
+                     const std::unordered_map<std::string, SiteMatch>& matches);
+
+// Site speeds per segment: sites resolve to a dense segment number once,
+// when the cache is loaded, and every publication sums into an array
+class SegmentProjection
+{
+  public:
+    bool load(const std::string& cachePath);
+
+    // Fold one site in; sites without a segment are ignored
+    void add(SiteKey site, const HarmonicSum& sum);
+
+    // Write "segment speed flow" for every segment that got a site and
+    // start the next publication
+    void write(std::ostream& out);
+
+    [[nodiscard]] std::size_t segments() const { return names_.size(); }
+
+  private:
+    std::unordered_map<SiteKey, std::uint32_t> rows_;
+    std::vector<std::string> names_;
+    std::vector<HarmonicSum> sums_;
+    std::vector<bool> used_;
+    std::vector<std::uint32_t> touched_; // rows used, in first-use order
+};
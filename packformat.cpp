@@ -0,0 +1,881 @@
+#include "packformat.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <libxml/xmlstring.h>
+#include <string>
+#include <utility>
+
+enum PackOp : std::uint8_t
+{
+    opEnd = 0,
+    opStart = 1,
+    opEmpty = 2,
+    opClose = 3,
+    opText = 4,
+    opCData = 5,
+    opComment = 6,
+    opInstruction = 7
+};
+
+enum ValueTag : std::uint8_t
+{
+    tagNew = 0, // string added to the value dictionary
+    tagRef = 1, // dictionary reference
+    tagRaw = 2, // string not worth interning
+    tagInteger = 3,
+    tagDecimal = 4
+};
+
+// Longest string that is added to the value dictionary
+constexpr std::size_t maxInterned = 64;
+
+// Most digits a mantissa may have and still fit an int64
+constexpr std::size_t maxDigits = 18;
+
+// Largest power of ten a double holds exactly
+constexpr std::size_t exactPowers = 23;
+
+// Largest mantissa a double holds exactly
+constexpr std::int64_t exactMantissa = std::int64_t{1} << 53U;
+
+bool isPacked(std::string_view head)
+{
+    return head.starts_with(packMagic);
+}
+
+// Parse text as an integer or decimal that prints back to exactly the same
+// text: no sign other than '-', no leading zeros, no "-0"
+static bool
+canonicalNumber(std::string_view text, std::int64_t& mantissa, std::size_t& scale)
+{
+    std::size_t pos = 0;
+    const bool negative = !text.empty() && text.front() == '-';
+    if (negative)
+    {
+        ++pos;
+    }
+
+    const std::size_t intStart = pos;
+    std::uint64_t value = 0;
+    std::size_t digits = 0;
+    auto takeDigits = [&]()
+    {
+        const std::size_t start = pos;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9')
+        {
+            value = value * 10 + static_cast<std::uint64_t>(text[pos] - '0');
+            ++pos;
+        }
+        digits += pos - start;
+        return pos - start;
+    };
+
+    const std::size_t intDigits = takeDigits();
+    if (intDigits == 0 || (intDigits > 1 && text[intStart] == '0'))
+    {
+        return false;
+    }
+    scale = 0;
+    if (pos < text.size() && text[pos] == '.')
+    {
+        ++pos;
+        scale = takeDigits();
+        if (scale == 0)
+        {
+            return false;
+        }
+    }
+    if (pos != text.size() || digits > maxDigits || (negative && value == 0))
+    {
+        return false;
+    }
+    mantissa = negative ? -static_cast<std::int64_t>(value)
+                        : static_cast<std::int64_t>(value);
+    return true;
+}
+
+// Buffered encoder state: interned names and values of one document
+class PackWriter
+{
+  public:
+    explicit PackWriter(std::ostream& out) : out_(out) {}
+
+    void op(PackOp code) { buffer_.push_back(static_cast<char>(code)); }
+
+    void varint(std::uint64_t value)
+    {
+        constexpr std::uint64_t low7 = 0x7FU;
+        constexpr std::uint64_t more = 0x80U;
+        while (value > low7)
+        {
+            buffer_.push_back(static_cast<char>((value & low7) | more));
+            value >>= 7U;
+        }
+        buffer_.push_back(static_cast<char>(value));
+    }
+
+    void string(std::string_view text)
+    {
+        varint(text.size());
+        buffer_.append(text);
+    }
+
+    void name(std::string_view text)
+    {
+        auto [it, added] = names_.try_emplace(std::string(text), names_.size() + 1);
+        if (!added)
+        {
+            varint(it->second);
+            return;
+        }
+        varint(0);
+        string(text);
+    }
+
+    void value(std::string_view text)
+    {
+        std::int64_t mantissa = 0;
+        std::size_t scale = 0;
+        if (canonicalNumber(text, mantissa, scale))
+        {
+            const auto bits = static_cast<std::uint64_t>(mantissa);
+            const std::uint64_t zigzag =
+                (bits << 1U) ^ static_cast<std::uint64_t>(mantissa >> 63U);
+            if (scale == 0)
+            {
+                buffer_.push_back(static_cast<char>(tagInteger));
+                varint(zigzag);
+            }
+            else
+            {
+                buffer_.push_back(static_cast<char>(tagDecimal));
+                varint(zigzag);
+                buffer_.push_back(static_cast<char>(scale));
+            }
+            return;
+        }
+
+        if (text.size() > maxInterned)
+        {
+            buffer_.push_back(static_cast<char>(tagRaw));
+            string(text);
+            return;
+        }
+        auto [it, added] =
+            values_.try_emplace(std::string(text), values_.size());
+        if (added)
+        {
+            buffer_.push_back(static_cast<char>(tagNew));
+            string(text);
+        }
+        else
+        {
+            buffer_.push_back(static_cast<char>(tagRef));
+            varint(it->second);
+        }
+    }
+
+    // Hand full buffers to the stream as the document is encoded
+    bool flush(bool force)
+    {
+        constexpr std::size_t flushSize = 1024 * 1024;
+        if (force || buffer_.size() >= flushSize)
+        {
+            out_.write(buffer_.data(),
+                       static_cast<std::streamsize>(buffer_.size()));
+            buffer_.clear();
+        }
+        return static_cast<bool>(out_);
+    }
+
+  private:
+    std::ostream& out_;
+    std::string buffer_;
+    std::unordered_map<std::string, std::uint64_t> names_;
+    std::unordered_map<std::string, std::uint64_t> values_;
+};
+
+static std::string_view toView(const xmlChar* text)
+{
+    if (text == nullptr)
+    {
+        return {};
+    }
+    // NOLINTBEGIN[cppcoreguidelines-pro-type-reinterpret-cast]
+    return {reinterpret_cast<const char*>(text),
+            static_cast<std::size_t>(xmlStrlen(text))};
+    // NOLINTEND[cppcoreguidelines-pro-type-reinterpret-cast]
+}
+
+bool packDocument(xmlTextReaderPtr reader, std::ostream& out)
+{
+    PackWriter writer(out);
+    out.write(packMagic.data(), static_cast<std::streamsize>(packMagic.size()));
+
+    std::vector<std::pair<std::string, std::string>> attributes;
+    int ret = 0;
+    while ((ret = xmlTextReaderRead(reader)) == 1)
+    {
+        switch (xmlTextReaderNodeType(reader))
+        {
+        case XML_READER_TYPE_ELEMENT:
+        {
+            const bool empty = xmlTextReaderIsEmptyElement(reader) == 1;
+            writer.op(empty ? opEmpty : opStart);
+            writer.name(toView(xmlTextReaderConstName(reader)));
+
+            attributes.clear();
+            while (xmlTextReaderMoveToNextAttribute(reader) == 1)
+            {
+                attributes.emplace_back(
+                    toView(xmlTextReaderConstName(reader)),
+                    toView(xmlTextReaderConstValue(reader)));
+            }
+            (void)xmlTextReaderMoveToElement(reader);
+
+            writer.varint(attributes.size());
+            for (const auto& [name, value] : attributes)
+            {
+                writer.name(name);
+                writer.value(value);
+            }
+            break;
+        }
+        case XML_READER_TYPE_END_ELEMENT:
+            writer.op(opClose);
+            break;
+        case XML_READER_TYPE_TEXT:
+        case XML_READER_TYPE_WHITESPACE:
+        case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+            writer.op(opText);
+            writer.value(toView(xmlTextReaderConstValue(reader)));
+            break;
+        case XML_READER_TYPE_CDATA:
+            writer.op(opCData);
+            writer.value(toView(xmlTextReaderConstValue(reader)));
+            break;
+        case XML_READER_TYPE_COMMENT:
+            writer.op(opComment);
+            writer.value(toView(xmlTextReaderConstValue(reader)));
+            break;
+        case XML_READER_TYPE_PROCESSING_INSTRUCTION:
+            writer.op(opInstruction);
+            writer.name(toView(xmlTextReaderConstName(reader)));
+            writer.value(toView(xmlTextReaderConstValue(reader)));
+            break;
+        default:
+            break;
+        }
+        if (!writer.flush(false))
+        {
+            return false;
+        }
+    }
+    writer.op(opEnd);
+    return writer.flush(true) && ret == 0;
+}
+
+static constexpr std::array<double, exactPowers> powersOfTen = [] {
+    std::array<double, exactPowers> powers{};
+    double power = 1.0;
+    for (double& entry : powers)
+    {
+        entry = power;
+        power *= 10.0;
+    }
+    return powers;
+}();
+
+std::string PackedValue::str() const
+{
+    if (kind == Kind::String)
+    {
+        return std::string(text);
+    }
+    const bool negative = mantissa < 0;
+    const std::uint64_t magnitude =
+        negative ? 0 - static_cast<std::uint64_t>(mantissa)
+                 : static_cast<std::uint64_t>(mantissa);
+    std::string digits = std::to_string(magnitude);
+    if (kind == Kind::Decimal)
+    {
+        if (digits.size() <= scale)
+        {
+            digits.insert(0, scale + 1 - digits.size(), '0');
+        }
+        digits.insert(digits.size() - scale, 1, '.');
+    }
+    return negative ? '-' + digits : digits;
+}
+
+bool PackedValue::toDouble(double& out) const
+{
+    if (kind == Kind::Integer)
+    {
+        out = static_cast<double>(mantissa);
+        return true;
+    }
+    if (kind == Kind::Decimal && scale < exactPowers &&
+        mantissa <= exactMantissa && mantissa >= -exactMantissa)
+    {
+        // Both operands are exact, so the division rounds like strtod; a
+        // longer mantissa would be rounded twice
+        out = static_cast<double>(mantissa) / powersOfTen.at(scale);
+        return true;
+    }
+    const std::string copy = str();
+    char* end = nullptr;
+    const double value = std::strtod(copy.c_str(), &end);
+    if (end == copy.c_str())
+    {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+bool PackedValue::toLong(long& out) const
+{
+    if (kind == Kind::Integer)
+    {
+        out = static_cast<long>(mantissa);
+        return true;
+    }
+    if (kind == Kind::Decimal)
+    {
+        // strtol stops at the decimal point: truncate toward zero
+        std::int64_t value = mantissa;
+        for (std::uint8_t i = 0; i < scale; ++i)
+        {
+            value /= 10;
+        }
+        out = static_cast<long>(value);
+        return true;
+    }
+    const std::string copy(text);
+    char* end = nullptr;
+    const int decimal = 10;
+    const long value = std::strtol(copy.c_str(), &end, decimal);
+    if (end == copy.c_str())
+    {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+PackReader::PackReader(std::string_view data) : data_(data)
+{
+    pos_ = isPacked(data) ? packMagic.size() : data.size();
+}
+
+bool PackReader::readVarint(std::uint64_t& out)
+{
+    constexpr unsigned int maxShift = 63;
+    constexpr std::uint8_t low7 = 0x7FU;
+    constexpr std::uint8_t more = 0x80U;
+    out = 0;
+    for (unsigned int shift = 0; pos_ < data_.size() && shift <= maxShift;
+         shift += 7)
+    {
+        const auto byte = static_cast<std::uint8_t>(data_[pos_++]);
+        out |= static_cast<std::uint64_t>(byte & low7) << shift;
+        if ((byte & more) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PackReader::readString(std::string_view& out)
+{
+    std::uint64_t length = 0;
+    if (!readVarint(length) || length > data_.size() - pos_)
+    {
+        return false;
+    }
+    out = data_.substr(pos_, length);
+    pos_ += length;
+    return true;
+}
+
+bool PackReader::readName(std::string_view& out)
+{
+    std::uint64_t ref = 0;
+    if (!readVarint(ref))
+    {
+        return false;
+    }
+    if (ref == 0)
+    {
+        if (!readString(out))
+        {
+            return false;
+        }
+        names_.push_back(out);
+        return true;
+    }
+    if (ref > names_.size())
+    {
+        return false;
+    }
+    out = names_[ref - 1];
+    return true;
+}
+
+bool PackReader::readValue(PackedValue& out)
+{
+    if (pos_ >= data_.size())
+    {
+        return false;
+    }
+    const auto tag = static_cast<std::uint8_t>(data_[pos_++]);
+    std::uint64_t number = 0;
+    switch (tag)
+    {
+    case tagNew:
+        out.kind = PackedValue::Kind::String;
+        if (!readString(out.text))
+        {
+            return false;
+        }
+        values_.push_back(out.text);
+        return true;
+    case tagRef:
+        out.kind = PackedValue::Kind::String;
+        if (!readVarint(number) || number >= values_.size())
+        {
+            return false;
+        }
+        out.text = values_[number];
+        return true;
+    case tagRaw:
+        out.kind = PackedValue::Kind::String;
+        return readString(out.text);
+    case tagInteger:
+    case tagDecimal:
+        if (!readVarint(number))
+        {
+            return false;
+        }
+        out.mantissa = static_cast<std::int64_t>(number >> 1U) ^
+                       -static_cast<std::int64_t>(number & 1U);
+        out.kind = PackedValue::Kind::Integer;
+        out.scale = 0;
+        if (tag == tagDecimal)
+        {
+            if (pos_ >= data_.size())
+            {
+                return false;
+            }
+            out.kind = PackedValue::Kind::Decimal;
+            out.scale = static_cast<std::uint8_t>(data_[pos_++]);
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+PackReader::Node PackReader::next()
+{
+    if (pos_ >= data_.size())
+    {
+        return Node::Error;
+    }
+    const auto code = static_cast<std::uint8_t>(data_[pos_++]);
+    switch (code)
+    {
+    case opEnd:
+        return Node::Done;
+    case opStart:
+    case opEmpty:
+    {
+        std::uint64_t count = 0;
+        if (!readName(name_) || !readVarint(count) ||
+            count > data_.size() - pos_)
+        {
+            return Node::Error;
+        }
+        attributes_.resize(count);
+        for (Attribute& attribute : attributes_)
+        {
+            if (!readName(attribute.name) || !readValue(attribute.value))
+            {
+                return Node::Error;
+            }
+        }
+        empty_ = code == opEmpty;
+        return Node::Start;
+    }
+    case opClose:
+        return Node::End;
+    case opText:
+        return readValue(value_) ? Node::Text : Node::Error;
+    case opCData:
+        return readValue(value_) ? Node::CData : Node::Error;
+    case opComment:
+        return readValue(value_) ? Node::Comment : Node::Error;
+    case opInstruction:
+        return readName(name_) && readValue(value_) ? Node::Instruction
+                                                    : Node::Error;
+    default:
+        return Node::Error;
+    }
+}
+
+static void escapeXml(std::string& out, std::string_view text, bool attribute)
+{
+    for (const char chr : text)
+    {
+        switch (chr)
+        {
+        case '&':
+            out += "&amp;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        case '"':
+            out += attribute ? "&quot;" : "\"";
+            break;
+        case '\n':
+            out += attribute ? "&#10;" : "\n";
+            break;
+        case '\r':
+            out += "&#13;";
+            break;
+        case '\t':
+            out += attribute ? "&#9;" : "\t";
+            break;
+        default:
+            out += chr;
+            break;
+        }
+    }
+}
+
+bool unpackToXml(std::string_view packed, std::ostream& out)
+{
+    constexpr std::size_t flushSize = 1024 * 1024;
+    PackReader reader(packed);
+    std::string buffer = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>";
+    std::vector<std::string_view> open;
+    for (;;)
+    {
+        switch (reader.next())
+        {
+        case PackReader::Node::Start:
+            buffer += '<';
+            buffer += reader.name();
+            for (const auto& attribute : reader.attributes())
+            {
+                buffer += ' ';
+                buffer += attribute.name;
+                buffer += "=\"";
+                escapeXml(buffer, attribute.value.str(), true);
+                buffer += '"';
+            }
+            if (reader.emptyElement())
+            {
+                buffer += "/>";
+            }
+            else
+            {
+                buffer += '>';
+                open.push_back(reader.name());
+            }
+            break;
+        case PackReader::Node::End:
+            if (open.empty())
+            {
+                return false;
+            }
+            buffer += "</";
+            buffer += open.back();
+            buffer += '>';
+            open.pop_back();
+            break;
+        case PackReader::Node::Text:
+            escapeXml(buffer, reader.value().str(), false);
+            break;
+        case PackReader::Node::CData:
+            buffer += "<![CDATA[";
+            buffer += reader.value().str();
+            buffer += "]]>";
+            break;
+        case PackReader::Node::Comment:
+            buffer += "<!--";
+            buffer += reader.value().str();
+            buffer += "-->";
+            break;
+        case PackReader::Node::Instruction:
+            buffer += "<?";
+            buffer += reader.name();
+            buffer += ' ';
+            buffer += reader.value().str();
+            buffer += "?>";
+            break;
+        case PackReader::Node::Done:
+            out.write(buffer.data(),
+                      static_cast<std::streamsize>(buffer.size()));
+            return open.empty() && static_cast<bool>(out);
+        case PackReader::Node::Error:
+            return false;
+        }
+        if (buffer.size() >= flushSize)
+        {
+            out.write(buffer.data(),
+                      static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+    }
+}
+
+static std::string_view localPart(std::string_view name)
+{
+    const std::size_t colon = name.rfind(':');
+    return colon == std::string_view::npos ? name : name.substr(colon + 1);
+}
+
+bool scanPackedPublicationKey(std::string_view head, PublicationKey& key)
+{
+    PackReader reader(head);
+    PublicationKey found;
+    bool inTime = false;
+    // The header ends where the first block starts; a head cut off in the
+    // middle of a node reads as an error
+    for (PackReader::Node node = reader.next();
+         node != PackReader::Node::Done && node != PackReader::Node::Error;
+         node = reader.next())
+    {
+        if (node == PackReader::Node::Start)
+        {
+            const std::string_view local = localPart(reader.name());
+            if (local == "siteMeasurements")
+            {
+                break;
+            }
+            inTime = local == "publicationTime" && !reader.emptyElement();
+            if (local == "measurementSiteTableReference")
+            {
+                for (const auto& attribute : reader.attributes())
+                {
+                    if (attribute.name == "version")
+                    {
+                        found.tableVersion = attribute.value.str();
+                    }
+                }
+            }
+            continue;
+        }
+        if (inTime && (node == PackReader::Node::Text ||
+                       node == PackReader::Node::CData))
+        {
+            found.publicationTime = reader.value().str();
+        }
+        inTime = false;
+    }
+    if (found.empty())
+    {
+        return false;
+    }
+    key = std::move(found);
+    return true;
+}
+
+// Open a --columns reading at an averageVehicleSpeed start tag; an empty
+// element is a complete reading
+static void startReading(const PackReader& reader, ParserState& state)
+{
+    state.reading = ColumnRow();
+    for (const auto& attribute : reader.attributes())
+    {
+        double value = 0.0;
+        if (attribute.name == "standardDeviation" && state.columns->stdDev &&
+            attribute.value.toDouble(value))
+        {
+            state.reading.stdDev = value;
+        }
+        else if (attribute.name == "numberOfInputValuesUsed" &&
+                 state.columns->inputs && attribute.value.toDouble(value))
+        {
+            state.reading.inputs = static_cast<long>(value);
+        }
+    }
+    if (reader.emptyElement())
+    {
+        state.readings.push_back(state.reading);
+        state.matchRows();
+    }
+}
+
+bool replayPacked(std::string_view packed, ParserState& state)
+{
+    return replayPacked(packed,
+                        state,
+                        [](const ParserState& block)
+                        {
+                            if (block.out != nullptr && !block.skipBlock)
+                            {
+                                emitBlock(*block.out, block);
+                            }
+                            return true;
+                        });
+}
+
+bool replayPacked(std::string_view packed,
+                  ParserState& state,
+                  const std::function<bool(const ParserState&)>& onBlock)
+{
+    enum class Field : std::uint8_t
+    {
+        None,
+        PublicationTime,
+        MeasurementTime,
+        Speed,
+        Flow
+    };
+
+    PackReader reader(packed);
+    std::vector<std::string_view> open;
+    Field field = Field::None;
+    for (;;)
+    {
+        switch (reader.next())
+        {
+        case PackReader::Node::Start:
+        {
+            const std::string_view local = localPart(reader.name());
+            field = Field::None;
+            if (local == "publicationTime")
+            {
+                field = Field::PublicationTime;
+            }
+            else if (local == "measurementTimeDefault")
+            {
+                field = Field::MeasurementTime;
+            }
+            else if (local == "siteMeasurements")
+            {
+                state.resetBlock();
+            }
+            else if (local == "measurementSiteReference")
+            {
+                state.siteId.clear();
+                for (const auto& attribute : reader.attributes())
+                {
+                    if (attribute.name == "id")
+                    {
+                        state.siteId = attribute.value.str();
+                    }
+                }
+                state.skipBlock = !state.accepts();
+            }
+            else if (local == "speed")
+            {
+                field = Field::Speed;
+            }
+            else if (local == "vehicleFlowRate")
+            {
+                field = Field::Flow;
+            }
+            else if (local == "averageVehicleSpeed" && state.columns != nullptr &&
+                     state.columns->speedData())
+            {
+                startReading(reader, state);
+            }
+
+            if (reader.emptyElement())
+            {
+                field = Field::None;
+            }
+            else
+            {
+                open.push_back(local);
+            }
+            break;
+        }
+        case PackReader::Node::Text:
+        case PackReader::Node::CData:
+        {
+            const PackedValue& value = reader.value();
+            double speed = 0.0;
+            long flow = 0;
+            if (field == Field::PublicationTime)
+            {
+                state.publicationTime = value.str();
+                if (state.out != nullptr && !state.binary)
+                {
+                    *state.out << state.publicationTime << '\n';
+                }
+            }
+            else if (field == Field::MeasurementTime)
+            {
+                state.measurementTime = value.str();
+            }
+            else if (field == Field::Speed && value.toDouble(speed))
+            {
+                if (state.columns == nullptr)
+                {
+                    state.speeds.push_back(speed);
+                    state.matchPairs();
+                }
+                else if (state.columns->speed)
+                {
+                    state.reading.speed = speed;
+                }
+            }
+            else if (field == Field::Flow && value.toLong(flow))
+            {
+                if (state.columns == nullptr)
+                {
+                    state.flows.push_back(flow);
+                    state.matchPairs();
+                }
+                else if (state.columns->flow)
+                {
+                    state.flows.push_back(flow);
+                    state.matchRows();
+                }
+            }
+            field = Field::None;
+            break;
+        }
+        case PackReader::Node::End:
+            field = Field::None;
+            if (open.empty())
+            {
+                return false;
+            }
+            if (open.back() == "averageVehicleSpeed" &&
+                state.columns != nullptr && state.columns->speedData())
+            {
+                state.readings.push_back(state.reading);
+                state.matchRows();
+            }
+            else if (open.back() == "siteMeasurements")
+            {
+                state.finishBlock(); // drop leftovers without match
+                if (!onBlock(state))
+                {
+                    return false;
+                }
+            }
+            open.pop_back();
+            break;
+        case PackReader::Node::Comment:
+        case PackReader::Node::Instruction:
+            break;
+        case PackReader::Node::Done:
+            return true;
+        case PackReader::Node::Error:
+            return false;
+        }
+    }
+}
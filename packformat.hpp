@@ -0,0 +1,123 @@
+#pragma once
+
+#include "feedparser.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <libxml/xmlreader.h>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Packed replay format: a compact structural encoding of an XML document
+// that keeps its full information content (elements, attributes, text,
+// comments, processing instructions, CDATA) without the XML syntax.
+//
+// The stream starts with packMagic, followed by one opcode byte per node.
+// Element and attribute names are interned: a name is written once as a
+// string and afterwards referenced by number. Values are typed: canonical
+// integers and decimals are stored as zigzag varints (plus the number of
+// decimals), short strings such as site ids and timestamps go to a value
+// dictionary, everything else is stored as a plain string.
+
+constexpr std::string_view packMagic = "XPK1";
+
+[[nodiscard]] bool isPacked(std::string_view head);
+
+// Encode the document read by reader; false on XML or write errors
+bool packDocument(xmlTextReaderPtr reader, std::ostream& out);
+
+// One decoded value: numbers keep their numeric form until text is needed
+struct PackedValue
+{
+    enum class Kind : std::uint8_t
+    {
+        String,
+        Integer,
+        Decimal
+    };
+
+    Kind kind = Kind::String;
+    std::string_view text; // String only
+    std::int64_t mantissa = 0;
+    std::uint8_t scale = 0; // digits after the decimal point
+
+    [[nodiscard]] std::string str() const;
+    [[nodiscard]] bool toDouble(double& out) const;
+    [[nodiscard]] bool toLong(long& out) const;
+};
+
+// Sequential decoder over a packed document held in memory
+class PackReader
+{
+  public:
+    enum class Node : std::uint8_t
+    {
+        Start,
+        End,
+        Text,
+        CData,
+        Comment,
+        Instruction,
+        Done,
+        Error
+    };
+
+    explicit PackReader(std::string_view data);
+
+    Node next();
+
+    // Valid after Start (element name) and Instruction (target)
+    [[nodiscard]] std::string_view name() const { return name_; }
+
+    // Valid after Text, CData, Comment and Instruction
+    [[nodiscard]] const PackedValue& value() const { return value_; }
+
+    // Valid after Start; an empty element is not followed by End
+    [[nodiscard]] bool emptyElement() const { return empty_; }
+
+    struct Attribute
+    {
+        std::string_view name;
+        PackedValue value;
+    };
+
+    [[nodiscard]] const std::vector<Attribute>& attributes() const
+    {
+        return attributes_;
+    }
+
+  private:
+    bool readVarint(std::uint64_t& out);
+    bool readString(std::string_view& out);
+    bool readName(std::string_view& out);
+    bool readValue(PackedValue& out);
+
+    std::string_view data_;
+    std::size_t pos_ = 0;
+    std::vector<std::string_view> names_;
+    std::vector<std::string_view> values_;
+    std::string_view name_;
+    PackedValue value_;
+    bool empty_ = false;
+    std::vector<Attribute> attributes_;
+};
+
+// Write a packed document back as XML
+bool unpackToXml(std::string_view packed, std::ostream& out);
+
+// Run the speed/flow extractor over a packed document; produces the same
+// output as the XML path through state.out, --columns projections included
+bool replayPacked(std::string_view packed, ParserState& state);
+
+// The same, handing every finished block to onBlock instead of writing it;
+// stops with false when onBlock returns false
+bool replayPacked(std::string_view packed,
+                  ParserState& state,
+                  const std::function<bool(const ParserState&)>& onBlock);
+
+// scanPublicationKey for the start of a packed document
+bool scanPackedPublicationKey(std::string_view head, PublicationKey& key);
@@ -0,0 +1,389 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "feedparser.hpp"
+#include "packformat.hpp"
+#include "records.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// CPython module over the block parser. pyxmline.parse(path, threads=1)
+// returns a Batch whose columns (site_key, index, speed, flow, time) export
+// the parser's column vectors through the buffer protocol, so
+// numpy.asarray(batch.speed) or memoryview(batch.flow) copy nothing. The GIL
+// is released while a feed is read and parsed. Packed feeds (xmlpack) are
+// replayed on one thread.
+
+struct ParsedFeed
+{
+    std::string publicationTime;
+    RecordBatch records;
+};
+
+// Read and parse one feed into columns; runs without the GIL
+static bool parseFeed(const std::string& path, unsigned int threads, ParsedFeed& feed)
+{
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    InputBuffer input;
+    const bool loaded = input.load(fd);
+    const int error = errno;
+    (void)close(fd);
+    if (!loaded)
+    {
+        errno = error;
+        return false;
+    }
+
+    const std::string_view doc = input.view();
+    std::ostringstream header; // only the publicationTime line goes here
+    if (isPacked(doc))
+    {
+        ParserState state;
+        state.out = &header;
+        state.batch = &feed.records;
+        if (!replayPacked(doc, state))
+        {
+            errno = EINVAL;
+            return false;
+        }
+        feed.publicationTime = state.publicationTime;
+        return true;
+    }
+
+    PublicationKey key;
+    (void)scanPublicationKey(doc.substr(0, publicationHeadSize), key);
+    feed.publicationTime = key.publicationTime;
+
+    std::vector<BlockEngine> engines(threads);
+    std::vector<RecordBatch> batches(threads);
+    for (unsigned int i = 0; i < threads; ++i)
+    {
+        engines[i].state.batch = &batches[i];
+    }
+    processDocument(doc, engines, nullptr, header);
+
+    feed.records = std::move(batches.front());
+    for (unsigned int i = 1; i < threads; ++i)
+    {
+        feed.records.append(batches[i]);
+    }
+    return true;
+}
+
+// Batch: owns the parsed feed; columns keep it alive
+struct BatchObject
+{
+    PyObject_HEAD
+    ParsedFeed* feed;
+};
+
+// Column: read-only buffer over one vector of its batch
+struct ColumnObject
+{
+    PyObject_HEAD
+    PyObject* owner;
+    void* data;
+    Py_ssize_t length;
+    Py_ssize_t itemSize;
+    const char* format;
+};
+
+static void columnDealloc(PyObject* self)
+{
+    auto* column = reinterpret_cast<ColumnObject*>(self); // NOLINT
+    PyTypeObject* type = Py_TYPE(self);
+    Py_XDECREF(column->owner);
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+static int columnGetBuffer(PyObject* self, Py_buffer* view, int flags)
+{
+    if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
+    {
+        PyErr_SetString(PyExc_BufferError, "column is read-only");
+        view->obj = nullptr;
+        return -1;
+    }
+    auto* column = reinterpret_cast<ColumnObject*>(self); // NOLINT
+    view->buf = column->data;
+    view->obj = Py_NewRef(self);
+    view->len = column->length * column->itemSize;
+    view->readonly = 1;
+    view->itemsize = column->itemSize;
+    view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT
+                       ? const_cast<char*>(column->format) // NOLINT
+                       : nullptr;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) == PyBUF_ND ? &column->length : nullptr;
+    view->strides =
+        (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &column->itemSize : nullptr;
+    view->suboffsets = nullptr;
+    view->internal = nullptr;
+    return 0;
+}
+
+static Py_ssize_t columnLength(PyObject* self)
+{
+    return reinterpret_cast<ColumnObject*>(self)->length; // NOLINT
+}
+
+// NOLINTBEGIN[cppcoreguidelines-avoid-c-arrays]
+static PyType_Slot columnSlots[] = {
+    {Py_tp_doc,
+     const_cast<char*>( // NOLINT
+         "Read-only column exported through the buffer protocol")},
+    {Py_tp_dealloc, reinterpret_cast<void*>(columnDealloc)},     // NOLINT
+    {Py_bf_getbuffer, reinterpret_cast<void*>(columnGetBuffer)}, // NOLINT
+    {Py_sq_length, reinterpret_cast<void*>(columnLength)},       // NOLINT
+    {0, nullptr},
+};
+// NOLINTEND[cppcoreguidelines-avoid-c-arrays]
+
+static PyType_Spec columnSpec = {
+    "pyxmline.Column",
+    sizeof(ColumnObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    columnSlots,
+};
+
+static PyTypeObject* columnType = nullptr;
+
+template <typename T>
+static PyObject* makeColumn(PyObject* owner, std::vector<T>& values, const char* format)
+{
+    auto* column = PyObject_New(ColumnObject, columnType);
+    if (column == nullptr)
+    {
+        return nullptr;
+    }
+    column->owner = Py_NewRef(owner);
+    column->data = values.data();
+    column->length = static_cast<Py_ssize_t>(values.size());
+    column->itemSize = static_cast<Py_ssize_t>(sizeof(T));
+    column->format = format;
+    return reinterpret_cast<PyObject*>(column); // NOLINT
+}
+
+static ParsedFeed& feedOf(PyObject* self)
+{
+    return *reinterpret_cast<BatchObject*>(self)->feed; // NOLINT
+}
+
+static void batchDealloc(PyObject* self)
+{
+    PyTypeObject* type = Py_TYPE(self);
+    delete reinterpret_cast<BatchObject*>(self)->feed; // NOLINT
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+static Py_ssize_t batchLength(PyObject* self)
+{
+    return static_cast<Py_ssize_t>(feedOf(self).records.size());
+}
+
+static PyObject* batchSiteKey(PyObject* self, void* /*closure*/)
+{
+    return makeColumn(self, feedOf(self).records.site, "Q");
+}
+
+static PyObject* batchIndex(PyObject* self, void* /*closure*/)
+{
+    return makeColumn(self, feedOf(self).records.index, "I");
+}
+
+static PyObject* batchSpeed(PyObject* self, void* /*closure*/)
+{
+    return makeColumn(self, feedOf(self).records.speed, "d");
+}
+
+static PyObject* batchFlow(PyObject* self, void* /*closure*/)
+{
+    return makeColumn(self, feedOf(self).records.flow, "q");
+}
+
+static PyObject* batchTime(PyObject* self, void* /*closure*/)
+{
+    return makeColumn(self, feedOf(self).records.time, "q");
+}
+
+static PyObject* batchPublicationTime(PyObject* self, void* /*closure*/)
+{
+    const std::string& text = feedOf(self).publicationTime;
+    return PyUnicode_FromStringAndSize(text.data(),
+                                       static_cast<Py_ssize_t>(text.size()));
+}
+
+static PyObject* batchSiteId(PyObject* self, PyObject* arg)
+{
+    const unsigned long long key = PyLong_AsUnsignedLongLong(arg);
+    if (PyErr_Occurred() != nullptr)
+    {
+        return nullptr;
+    }
+    const std::string id = feedOf(self).records.siteId(key);
+    return PyUnicode_FromStringAndSize(id.data(),
+                                       static_cast<Py_ssize_t>(id.size()));
+}
+
+static PyTypeObject* batchType = nullptr;
+
+// Batches never change once parsed, so columns exported from them stay
+// valid and several threads may read one; sorting fills a new batch
+static PyObject* batchSortBySite(PyObject* self, PyObject* /*unused*/)
+{
+    auto sorted = std::make_unique<ParsedFeed>();
+    const ParsedFeed& feed = feedOf(self);
+    PyThreadState* thread = PyEval_SaveThread();
+    *sorted = feed;
+    sorted->records.sortBySite();
+    PyEval_RestoreThread(thread);
+
+    auto* batch = PyObject_New(BatchObject, batchType);
+    if (batch == nullptr)
+    {
+        return nullptr;
+    }
+    batch->feed = sorted.release();
+    return reinterpret_cast<PyObject*>(batch); // NOLINT
+}
+
+// NOLINTBEGIN[cppcoreguidelines-avoid-c-arrays]
+static PyGetSetDef batchGetSet[] = {
+    {"site_key", batchSiteKey, nullptr, "site keys (uint64)", nullptr},
+    {"index", batchIndex, nullptr, "pair number in the block (uint32)", nullptr},
+    {"speed", batchSpeed, nullptr, "speeds (float64)", nullptr},
+    {"flow", batchFlow, nullptr, "vehicle flow rates (int64)", nullptr},
+    {"time",
+     batchTime,
+     nullptr,
+     "measurementTimeDefault, ms since the epoch (int64)",
+     nullptr},
+    {"publication_time",
+     batchPublicationTime,
+     nullptr,
+     "publicationTime of the feed",
+     nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr},
+};
+
+static PyMethodDef batchMethods[] = {
+    {"site_id", batchSiteId, METH_O, "site id of a site key"},
+    {"sort_by_site",
+     batchSortBySite,
+     METH_NOARGS,
+     "new batch with the rows sorted by (site key, index)"},
+    {nullptr, nullptr, 0, nullptr},
+};
+// NOLINTEND[cppcoreguidelines-avoid-c-arrays]
+
+// NOLINTBEGIN[cppcoreguidelines-avoid-c-arrays]
+static PyType_Slot batchSlots[] = {
+    {Py_tp_doc,
+     const_cast<char*>("Parsed records of one feed, in columns")}, // NOLINT
+    {Py_tp_dealloc, reinterpret_cast<void*>(batchDealloc)}, // NOLINT
+    {Py_sq_length, reinterpret_cast<void*>(batchLength)},   // NOLINT
+    {Py_tp_getset, batchGetSet},
+    {Py_tp_methods, batchMethods},
+    {0, nullptr},
+};
+// NOLINTEND[cppcoreguidelines-avoid-c-arrays]
+
+static PyType_Spec batchSpec = {
+    "pyxmline.Batch",
+    sizeof(BatchObject),
+    0,
+    Py_TPFLAGS_DEFAULT,
+    batchSlots,
+};
+
+static PyObject* parse(PyObject* /*module*/, PyObject* args, PyObject* kwargs)
+{
+    const char* path = nullptr;
+    unsigned int threads = 1;
+    // NOLINTNEXTLINE[cppcoreguidelines-avoid-c-arrays]
+    static const char* keywords[] = {"path", "threads", nullptr};
+    if (PyArg_ParseTupleAndKeywords(args,
+                                    kwargs,
+                                    "s|I",
+                                    const_cast<char**>(keywords), // NOLINT
+                                    &path,
+                                    &threads) == 0)
+    {
+        return nullptr;
+    }
+    constexpr unsigned int maxThreads = 256;
+    if (threads == 0 || threads > maxThreads)
+    {
+        PyErr_SetString(PyExc_ValueError, "threads must be 1..256");
+        return nullptr;
+    }
+
+    auto feed = std::make_unique<ParsedFeed>();
+    const std::string file = path;
+    PyThreadState* thread = PyEval_SaveThread();
+    const bool ok = parseFeed(file, threads, *feed);
+    PyEval_RestoreThread(thread);
+    if (!ok)
+    {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    }
+
+    auto* batch = PyObject_New(BatchObject, batchType);
+    if (batch == nullptr)
+    {
+        return nullptr;
+    }
+    batch->feed = feed.release();
+    return reinterpret_cast<PyObject*>(batch); // NOLINT
+}
+
+// NOLINTBEGIN[cppcoreguidelines-avoid-c-arrays]
+static PyMethodDef moduleMethods[] = {
+    {"parse",
+     reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(parse)), // NOLINT
+     METH_VARARGS | METH_KEYWORDS,
+     "parse(path, threads=1) -> Batch"},
+    {nullptr, nullptr, 0, nullptr},
+};
+// NOLINTEND[cppcoreguidelines-avoid-c-arrays]
+
+static PyModuleDef moduleDef = {
+    PyModuleDef_HEAD_INIT,
+    "pyxmline",
+    "Columnar access to NDW traffic feeds parsed by the xmline block parser.",
+    -1,
+    moduleMethods,
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr,
+};
+
+PyMODINIT_FUNC PyInit_pyxmline()
+{
+    columnType = reinterpret_cast<PyTypeObject*>( // NOLINT
+        PyType_FromSpec(&columnSpec));
+    batchType = reinterpret_cast<PyTypeObject*>( // NOLINT
+        PyType_FromSpec(&batchSpec));
+    if (columnType == nullptr || batchType == nullptr)
+    {
+        return nullptr;
+    }
+    xmlInitParser();
+    return PyModule_Create(&moduleDef);
+}
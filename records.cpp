@@ -0,0 +1,569 @@
+#include "records.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <unistd.h>
+
+constexpr std::uint64_t recordKeySeed = 0x52454344ULL;
+constexpr std::int64_t msPerSecond = 1000;
+constexpr std::int64_t secondsPerDay = 86400;
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+static std::int64_t daysFromCivil(std::int64_t year, unsigned month, unsigned day)
+{
+    year -= month <= 2 ? 1 : 0;
+    const std::int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const auto yearOfEra = static_cast<unsigned>(year - era * 400);
+    const unsigned dayOfYear =
+        (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned dayOfEra =
+        yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<std::int64_t>(dayOfEra) - 719468;
+}
+
+// Read exactly count digits at pos
+static bool readDigits(std::string_view text,
+                       std::size_t& pos,
+                       std::size_t count,
+                       unsigned& value)
+{
+    value = 0;
+    for (std::size_t end = pos + count; pos < end; ++pos)
+    {
+        if (pos >= text.size() || text[pos] < '0' || text[pos] > '9')
+        {
+            return false;
+        }
+        value = value * 10 + static_cast<unsigned>(text[pos] - '0');
+    }
+    return true;
+}
+
+static bool expect(std::string_view text, std::size_t& pos, char c)
+{
+    if (pos >= text.size() || text[pos] != c)
+    {
+        return false;
+    }
+    ++pos;
+    return true;
+}
+
+bool parseIsoTime(std::string_view text, std::int64_t& ms)
+{
+    std::size_t pos = 0;
+    unsigned year = 0;
+    unsigned month = 0;
+    unsigned day = 0;
+    unsigned hour = 0;
+    unsigned minute = 0;
+    unsigned second = 0;
+    if (!readDigits(text, pos, 4, year) || !expect(text, pos, '-') ||
+        !readDigits(text, pos, 2, month) || !expect(text, pos, '-') ||
+        !readDigits(text, pos, 2, day) || !expect(text, pos, 'T') ||
+        !readDigits(text, pos, 2, hour) || !expect(text, pos, ':') ||
+        !readDigits(text, pos, 2, minute) || !expect(text, pos, ':') ||
+        !readDigits(text, pos, 2, second) || month < 1 || month > 12 ||
+        day < 1 || day > 31)
+    {
+        return false;
+    }
+
+    // Fraction: keep milliseconds, ignore finer digits
+    std::int64_t fraction = 0;
+    if (pos < text.size() && text[pos] == '.')
+    {
+        std::int64_t scale = 100;
+        for (++pos; pos < text.size() && text[pos] >= '0' && text[pos] <= '9';
+             ++pos)
+        {
+            fraction += (text[pos] - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    std::int64_t offset = 0;
+    if (pos < text.size() && (text[pos] == '+' || text[pos] == '-'))
+    {
+        const bool negative = text[pos++] == '-';
+        unsigned offsetHours = 0;
+        unsigned offsetMinutes = 0;
+        if (!readDigits(text, pos, 2, offsetHours) || !expect(text, pos, ':') ||
+            !readDigits(text, pos, 2, offsetMinutes))
+        {
+            return false;
+        }
+        offset = (offsetHours * 60 + offsetMinutes) * 60;
+        offset = negative ? -offset : offset;
+    }
+    else if (pos < text.size() && text[pos] == 'Z')
+    {
+        ++pos;
+    }
+    if (pos != text.size())
+    {
+        return false;
+    }
+
+    const std::int64_t seconds =
+        daysFromCivil(year, month, day) * secondsPerDay + hour * 3600 +
+        minute * 60 + second - offset;
+    ms = seconds * msPerSecond + fraction;
+    return true;
+}
+
+std::string formatIsoTime(std::int64_t ms)
+{
+    std::int64_t seconds = ms / msPerSecond;
+    std::int64_t millis = ms % msPerSecond;
+    if (millis < 0)
+    {
+        millis += msPerSecond;
+        --seconds;
+    }
+    std::int64_t days = seconds / secondsPerDay;
+    std::int64_t rest = seconds % secondsPerDay;
+    if (rest < 0)
+    {
+        rest += secondsPerDay;
+        --days;
+    }
+
+    // Civil date from days since the epoch
+    days += 719468;
+    const std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const auto dayOfEra = static_cast<unsigned>(days - era * 146097);
+    const unsigned yearOfEra =
+        (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) /
+        365;
+    const unsigned dayOfYear =
+        dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const unsigned mp = (5 * dayOfYear + 2) / 153;
+    const unsigned day = dayOfYear - (153 * mp + 2) / 5 + 1;
+    const unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    const std::int64_t year =
+        static_cast<std::int64_t>(yearOfEra) + era * 400 + (month <= 2 ? 1 : 0);
+
+    std::array<char, 40> text{};
+    const int length =
+        millis == 0
+            ? std::snprintf(text.data(),
+                            text.size(),
+                            "%04lld-%02u-%02uT%02lld:%02lld:%02lldZ",
+                            static_cast<long long>(year),
+                            month,
+                            day,
+                            static_cast<long long>(rest / 3600),
+                            static_cast<long long>(rest / 60 % 60),
+                            static_cast<long long>(rest % 60))
+            : std::snprintf(text.data(),
+                            text.size(),
+                            "%04lld-%02u-%02uT%02lld:%02lld:%02lld.%03lldZ",
+                            static_cast<long long>(year),
+                            month,
+                            day,
+                            static_cast<long long>(rest / 3600),
+                            static_cast<long long>(rest / 60 % 60),
+                            static_cast<long long>(rest % 60),
+                            static_cast<long long>(millis));
+    return {text.data(), static_cast<std::size_t>(length)};
+}
+
+SiteKey recordSiteKey(std::string_view siteId)
+{
+    SiteKey key = 0;
+    if (packSiteId(siteId, key))
+    {
+        return key;
+    }
+    return hashBytes(siteId, recordKeySeed) & ~packedSiteKeyFlag;
+}
+
+template <typename T> static void putValue(std::ostream& out, T value)
+{
+    std::array<char, sizeof(T)> bytes{};
+    std::memcpy(bytes.data(), &value, sizeof(T));
+    out.write(bytes.data(), bytes.size());
+}
+
+static void writeRecord(std::ostream& out,
+                        SiteKey key,
+                        std::int64_t ms,
+                        std::string_view name,
+                        const std::vector<Measurement>& pairs)
+{
+    putValue(out, key);
+    putValue(out, ms);
+    putValue(out, static_cast<std::uint32_t>(pairs.size()));
+    putValue(out, static_cast<std::uint32_t>(name.size()));
+    out << name;
+    for (const Measurement& pair : pairs)
+    {
+        putValue(out, pair.speed);
+        putValue(out, static_cast<std::int64_t>(pair.flow));
+    }
+}
+
+void writeBinaryBlock(std::ostream& out,
+                      const std::string& siteId,
+                      std::string_view time,
+                      const std::vector<Measurement>& pairs)
+{
+    const SiteKey key = recordSiteKey(siteId);
+    std::int64_t ms = 0;
+    (void)parseIsoTime(time, ms);
+    writeRecord(out,
+                key,
+                ms,
+                isPackedSiteKey(key) ? std::string_view() : siteId,
+                pairs);
+}
+
+void writeBlockRecord(std::ostream& out, const BlockRecord& record)
+{
+    writeRecord(out, record.site, record.time, record.name, record.pairs);
+}
+
+RecordReader::RecordReader(int fd, std::size_t readAhead)
+    : fd_(fd), buffer_(readAhead)
+{
+}
+
+// Make need bytes available, moving the unread tail to the front first
+bool RecordReader::fill(std::size_t need)
+{
+    if (end_ - begin_ >= need)
+    {
+        return true;
+    }
+    std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+    while (end_ < need && !eof_)
+    {
+        const ssize_t got =
+            read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            eof_ = true;
+            break;
+        }
+        end_ += static_cast<std::size_t>(got);
+    }
+    return end_ >= need;
+}
+
+// Copy size bytes out, in buffer sized pieces for large fields
+bool RecordReader::take(void* into, std::size_t size)
+{
+    auto* target = static_cast<char*>(into);
+    while (size > 0)
+    {
+        const std::size_t piece = std::min(size, buffer_.size());
+        if (!fill(piece))
+        {
+            return false;
+        }
+        std::memcpy(target, buffer_.data() + begin_, piece);
+        begin_ += piece;
+        target += piece;
+        size -= piece;
+    }
+    return true;
+}
+
+bool RecordReader::open()
+{
+    std::array<char, recordMagic.size()> magic{};
+    return take(magic.data(), magic.size()) &&
+           std::string_view(magic.data(), magic.size()) == recordMagic;
+}
+
+bool RecordReader::next(BlockRecord& record)
+{
+    std::uint32_t count = 0;
+    std::uint32_t nameLength = 0;
+    if (!fill(1))
+    {
+        return false; // clean end of stream
+    }
+    if (!take(&record.site, sizeof(record.site)) ||
+        !take(&record.time, sizeof(record.time)) ||
+        !take(&count, sizeof(count)) || !take(&nameLength, sizeof(nameLength)))
+    {
+        truncated_ = true;
+        return false;
+    }
+    record.name.resize(nameLength);
+    if (!take(record.name.data(), nameLength))
+    {
+        truncated_ = true;
+        return false;
+    }
+    record.pairs.resize(count);
+    for (Measurement& pair : record.pairs)
+    {
+        std::int64_t flow = 0;
+        if (!take(&pair.speed, sizeof(pair.speed)) ||
+            !take(&flow, sizeof(flow)))
+        {
+            truncated_ = true;
+            return false;
+        }
+        pair.flow = static_cast<long>(flow);
+    }
+    return true;
+}
+
+SortedRecordBuffer::int_type SortedRecordBuffer::overflow(int_type c)
+{
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        pending_ += traits_type::to_char_type(c);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize SortedRecordBuffer::xsputn(const char* s, std::streamsize n)
+{
+    pending_.append(s, static_cast<std::size_t>(n));
+    return n;
+}
+
+bool SortedRecordBuffer::endRun()
+{
+    struct Entry
+    {
+        std::int64_t time;
+        SiteKey site;
+        std::size_t offset;
+        std::size_t length;
+    };
+    constexpr std::size_t headerSize = 2 * sizeof(std::uint64_t) +
+                                       2 * sizeof(std::uint32_t);
+    constexpr std::size_t pairSize = sizeof(double) + sizeof(std::int64_t);
+
+    std::vector<Entry> entries;
+    std::size_t pos = 0;
+    while (pos + headerSize <= pending_.size())
+    {
+        Entry entry = {0, 0, pos, 0};
+        std::uint32_t count = 0;
+        std::uint32_t nameLength = 0;
+        const char* header = pending_.data() + pos;
+        std::memcpy(&entry.site, header, sizeof(entry.site));
+        std::memcpy(&entry.time, header + 8, sizeof(entry.time));
+        std::memcpy(&count, header + 16, sizeof(count));
+        std::memcpy(&nameLength, header + 20, sizeof(nameLength));
+        entry.length = headerSize + nameLength + count * pairSize;
+        if (entry.length > pending_.size() - pos)
+        {
+            break;
+        }
+        entries.push_back(entry);
+        pos += entry.length;
+    }
+    bool ok = pos == pending_.size();
+
+    std::stable_sort(entries.begin(),
+                     entries.end(),
+                     [](const Entry& lhs, const Entry& rhs)
+                     {
+                         return lhs.time != rhs.time ? lhs.time < rhs.time
+                                                     : lhs.site < rhs.site;
+                     });
+    for (const Entry& entry : entries)
+    {
+        const auto length = static_cast<std::streamsize>(entry.length);
+        if (target_->sputn(pending_.data() + entry.offset, length) != length)
+        {
+            ok = false;
+            break;
+        }
+    }
+    pending_.clear();
+    return ok;
+}
+
+void RecordBatch::append(const ParserState& state)
+{
+    const SiteKey key = recordSiteKey(state.siteId);
+    if (!isPackedSiteKey(key))
+    {
+        names_.try_emplace(key, state.siteId);
+    }
+    std::int64_t ms = 0;
+    (void)parseIsoTime(state.measurementTime.empty() ? state.publicationTime
+                                                     : state.measurementTime,
+                       ms);
+    std::uint32_t idx = 1;
+    for (const Measurement& pair : state.pairs)
+    {
+        site.push_back(key);
+        index.push_back(idx++);
+        speed.push_back(pair.speed);
+        flow.push_back(pair.flow);
+        time.push_back(ms);
+    }
+}
+
+void RecordBatch::append(const RecordBatch& other)
+{
+    site.insert(site.end(), other.site.begin(), other.site.end());
+    index.insert(index.end(), other.index.begin(), other.index.end());
+    speed.insert(speed.end(), other.speed.begin(), other.speed.end());
+    flow.insert(flow.end(), other.flow.begin(), other.flow.end());
+    time.insert(time.end(), other.time.begin(), other.time.end());
+    names_.insert(other.names_.begin(), other.names_.end());
+}
+
+// Keeps the capacity, so the next publication reuses the buffers
+void RecordBatch::clear()
+{
+    site.clear();
+    index.clear();
+    speed.clear();
+    flow.clear();
+    time.clear();
+    names_.clear();
+}
+
+// Drop rows added after the first rows, e.g. by a rejected speculation
+void RecordBatch::truncate(std::size_t rows)
+{
+    site.resize(rows);
+    index.resize(rows);
+    speed.resize(rows);
+    flow.resize(rows);
+    time.resize(rows);
+}
+
+template <typename T> void RecordBatch::permute(std::vector<T>& column)
+{
+    static_assert(sizeof(T) == sizeof(std::uint64_t) ||
+                  sizeof(T) == sizeof(std::uint32_t));
+    gather_.resize(column.size());
+    for (std::size_t i = 0; i < order_.size(); ++i)
+    {
+        std::memcpy(&gather_[i], &column[order_[i]], sizeof(T));
+    }
+    for (std::size_t i = 0; i < order_.size(); ++i)
+    {
+        std::memcpy(&column[i], &gather_[i], sizeof(T));
+    }
+}
+
+void RecordBatch::sortBySite()
+{
+    // Rows arrive as blocks: runs of one site with increasing index. Sort
+    // the runs, not the rows, keyed by value so passes read sequentially.
+    runs_.clear();
+    for (std::size_t row = 0; row < size(); ++row)
+    {
+        if (row == 0 || site[row] != site[row - 1] ||
+            index[row] <= index[row - 1])
+        {
+            runs_.push_back({site[row], static_cast<std::uint32_t>(row), 0});
+        }
+        ++runs_.back().length;
+    }
+
+    constexpr std::size_t radix = 256;
+    const std::size_t n = runs_.size();
+    runScratch_.resize(n);
+    for (unsigned int shift = 0; shift < 64 && n > 0; shift += 8)
+    {
+        auto digitOf = [shift](const Run& run)
+        { return static_cast<std::size_t>(run.site >> shift) & (radix - 1); };
+        std::array<std::size_t, radix> counts{};
+        for (const Run& run : runs_)
+        {
+            ++counts[digitOf(run)];
+        }
+        if (counts[digitOf(runs_.front())] == n)
+        {
+            continue; // every run has this digit
+        }
+        std::size_t offset = 0;
+        for (std::size_t& count : counts)
+        {
+            offset += std::exchange(count, offset);
+        }
+        for (const Run& run : runs_)
+        {
+            runScratch_[counts[digitOf(run)]++] = run;
+        }
+        runs_.swap(runScratch_);
+    }
+
+    // Expand the runs; a site with several blocks is ordered by index
+    order_.clear();
+    for (std::size_t i = 0; i < n;)
+    {
+        const std::size_t groupBegin = order_.size();
+        std::size_t j = i;
+        for (; j < n && runs_[j].site == runs_[i].site; ++j)
+        {
+            for (std::uint32_t k = 0; k < runs_[j].length; ++k)
+            {
+                order_.push_back(runs_[j].begin + k);
+            }
+        }
+        if (j - i > 1)
+        {
+            std::stable_sort(order_.begin() + static_cast<std::ptrdiff_t>(groupBegin),
+                             order_.end(),
+                             [this](std::uint32_t lhs, std::uint32_t rhs)
+                             { return index[lhs] < index[rhs]; });
+        }
+        i = j;
+    }
+
+    permute(site);
+    permute(index);
+    permute(speed);
+    permute(flow);
+    permute(time);
+}
+
+std::string RecordBatch::siteId(SiteKey key) const
+{
+    if (isPackedSiteKey(key))
+    {
+        return unpackSiteKey(key);
+    }
+    const auto it = names_.find(key);
+    return it == names_.end() ? std::string() : it->second;
+}
+
+void RecordBatch::write(std::ostream& out,
+                        const std::vector<char>& sources) const
+{
+    std::string name;
+    for (std::size_t i = 0; i < size(); ++i)
+    {
+        if (i == 0 || site[i] != site[i - 1])
+        {
+            name = siteId(site[i]);
+            if (name.empty())
+            {
+                name = "(unknown_site)";
+            }
+        }
+        out << index[i] << ' ' << name << ' ' << std::defaultfloat << speed[i]
+            << ' ' << flow[i];
+        if (!sources.empty())
+        {
+            out << ' ' << sources[i];
+        }
+        out << '\n';
+    }
+}
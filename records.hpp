@@ -0,0 +1,145 @@
+#pragma once
+
+#include "feedparser.hpp"
+#include "sitekey.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Binary block records (xmline --binary). A stream is recordMagic followed
+// by one record per siteMeasurements block, in host byte order:
+//   u64 site key, i64 time (ms since the epoch, measurementTimeDefault),
+//   u32 pair count, u32 name length, the site id (only when the key is not
+//   packed), then per pair f64 speed and i64 flow.
+// Unpackable ids are keyed by a 63-bit hash of the id, so keys agree
+// across streams and records can be merged without a shared table.
+// xmline writes the records of every document sorted by (time, site key),
+// so a stream of one document is a run xmlmerge can merge directly.
+
+constexpr std::string_view recordMagic = "XRB1";
+
+// Parse an xs:dateTime like 2025-12-12T12:01:00Z or 2025-12-12T13:01:00.5+01:00
+bool parseIsoTime(std::string_view text, std::int64_t& ms);
+
+// Format as UTC, with milliseconds only when there are any
+std::string formatIsoTime(std::int64_t ms);
+
+// Key a site id the way binary records do
+SiteKey recordSiteKey(std::string_view siteId);
+
+struct BlockRecord
+{
+    SiteKey site = 0;
+    std::int64_t time = 0;
+    std::string name; // site id, empty for packed keys
+    std::vector<Measurement> pairs;
+
+    [[nodiscard]] std::string siteId() const
+    {
+        return isPackedSiteKey(site) ? unpackSiteKey(site) : name;
+    }
+};
+
+void writeBinaryBlock(std::ostream& out,
+                      const std::string& siteId,
+                      std::string_view time,
+                      const std::vector<Measurement>& pairs);
+
+void writeBlockRecord(std::ostream& out, const BlockRecord& record);
+
+// Records of one publication in columns, one row per speed/flow pair.
+// Filled instead of writing output while ParserState::batch is set.
+class RecordBatch
+{
+  public:
+    std::vector<SiteKey> site;
+    std::vector<std::uint32_t> index; // pair number within the block
+    std::vector<double> speed;
+    std::vector<std::int64_t> flow;
+    std::vector<std::int64_t> time; // measurementTimeDefault, ms
+
+    [[nodiscard]] std::size_t size() const { return site.size(); }
+
+    void append(const ParserState& state);
+    void append(const RecordBatch& other);
+    void clear();
+    void truncate(std::size_t rows);
+
+    // Stable sort by (site key, index): an LSD radix sort of the block runs
+    // on the site key, 8 bits per pass, skipping passes whose digit is the
+    // same for every run
+    void sortBySite();
+
+    // Text lines as xmline writes them: idx site speed flow, followed by
+    // the flag of each row when sources is not empty
+    void write(std::ostream& out, const std::vector<char>& sources = {}) const;
+
+    [[nodiscard]] std::string siteId(SiteKey key) const;
+
+  private:
+    template <typename T> void permute(std::vector<T>& column);
+
+    std::unordered_map<SiteKey, std::string> names_; // ids of unpacked keys
+    // Sort buffers, kept across publications
+    struct Run
+    {
+        SiteKey site;
+        std::uint32_t begin;
+        std::uint32_t length;
+    };
+    std::vector<Run> runs_;
+    std::vector<Run> runScratch_;
+    std::vector<std::uint32_t> order_;
+    std::vector<std::uint64_t> gather_; // reused for every column
+};
+
+// Reads records from a descriptor through a fixed read-ahead buffer
+class RecordReader
+{
+  public:
+    RecordReader(int fd, std::size_t readAhead);
+
+    // Check the stream magic; false when the input is not a record stream
+    bool open();
+
+    // Next record; false at the end of the stream or on a truncated record
+    bool next(BlockRecord& record);
+
+    [[nodiscard]] bool truncated() const { return truncated_; }
+
+  private:
+    bool fill(std::size_t need);
+    bool take(void* into, std::size_t size);
+
+    int fd_;
+    std::vector<char> buffer_;
+    std::size_t begin_ = 0;
+    std::size_t end_ = 0;
+    bool eof_ = false;
+    bool truncated_ = false;
+};
+
+// Collects the records of one document and passes them on sorted by
+// (time, site key)
+class SortedRecordBuffer : public std::streambuf
+{
+  public:
+    explicit SortedRecordBuffer(std::streambuf* target) : target_(target) {}
+
+    // Sort and forward what was collected; false on a malformed record
+    bool endRun();
+
+  protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+  private:
+    std::streambuf* target_;
+    std::string pending_;
+};
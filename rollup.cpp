@@ -0,0 +1,131 @@
+#include "rollup.hpp"
+#include "extractor.hpp"
+#include "feedparser.hpp"
+#include "records.hpp"
+
+#include <algorithm>
+#include <array>
+#include <libxml/parser.h>
+#include <string_view>
+
+using SiteNames =
+    Extractor<"measurementSiteRecord",
+              Field<"measurementSiteRecord", std::string, "id">,
+              Field<"measurementSiteName", std::string>>;
+
+constexpr std::string_view countryName = "all";
+
+SiteRollup::SiteRollup()
+{
+    (void)node(Level::Country, std::string(countryName));
+}
+
+bool SiteRollup::load(const std::string& path)
+{
+    xmlTextReaderPtr reader =
+        xmlReaderForFile(path.c_str(), nullptr, xmlReaderOptions());
+    if (reader == nullptr)
+    {
+        return false;
+    }
+    SiteNames names;
+    const int status = names.run(
+        reader,
+        [this](const SiteNames::Values& values)
+        {
+            const auto& [id, name] = values;
+            const std::size_t begin = name.find_first_not_of(' ');
+            if (id.empty() || begin == std::string::npos)
+            {
+                return;
+            }
+            const std::size_t end = name.find(' ', begin);
+            roadNames_[recordSiteKey(id)] = name.substr(
+                begin, end == std::string::npos ? end : end - begin);
+        });
+    xmlFreeTextReader(reader);
+    return status == 0;
+}
+
+std::uint32_t SiteRollup::node(Level level, const std::string& name)
+{
+    std::string key(1, static_cast<char>('0' + static_cast<int>(level)));
+    key += name;
+    const auto [found, added] = nodeNumbers_.try_emplace(
+        std::move(key), static_cast<std::uint32_t>(names_.size()));
+    if (added)
+    {
+        levels_.push_back(level);
+        names_.push_back(name);
+        // Node 0 is the country, created first
+        parents_.push_back(level == Level::Region ? 0 : noNode);
+        sums_.emplace_back();
+        counts_.push_back(0);
+    }
+    return found->second;
+}
+
+// Dense number of a site, placed in its road and region the first time
+std::uint32_t SiteRollup::site(SiteKey key, const RecordBatch& batch)
+{
+    const auto [found, added] =
+        sites_.try_emplace(key, static_cast<std::uint32_t>(siteRegion_.size()));
+    if (added)
+    {
+        const std::string id = batch.siteId(key);
+        siteRegion_.push_back(node(Level::Region, id.substr(0, id.find('_'))));
+        const auto road = roadNames_.find(key);
+        siteRoad_.push_back(road == roadNames_.end()
+                                ? noNode
+                                : node(Level::Road, road->second));
+    }
+    return found->second;
+}
+
+void SiteRollup::build(const SiteAggregate& sites, const RecordBatch& batch)
+{
+    std::ranges::fill(sums_, HarmonicSum{});
+    std::ranges::fill(counts_, 0U);
+    for (std::size_t i = 0; i < sites.size(); ++i)
+    {
+        if (sites.speed[i] <= 0 && sites.flow[i] <= 0)
+        {
+            continue;
+        }
+        const std::uint32_t row = site(sites.site[i], batch);
+        const HarmonicSum sum = sites.sum(i);
+        const std::uint32_t reporting = sites.speed[i] > 0 ? 1 : 0;
+        sums_[siteRegion_[row]].add(sum);
+        counts_[siteRegion_[row]] += reporting;
+        if (siteRoad_[row] != noNode)
+        {
+            sums_[siteRoad_[row]].add(sum);
+            counts_[siteRoad_[row]] += reporting;
+        }
+    }
+    // Children come after their parents
+    for (std::size_t n = names_.size(); n-- > 1;)
+    {
+        if (parents_[n] != noNode)
+        {
+            sums_[parents_[n]].add(sums_[n]);
+            counts_[parents_[n]] += counts_[n];
+        }
+    }
+}
+
+void SiteRollup::write(std::ostream& out) const
+{
+    static constexpr std::array<std::string_view, 3> levelNames = {
+        "country", "region", "road"};
+    for (std::size_t n = 0; n < names_.size(); ++n)
+    {
+        if (sums_[n].flow == 0 && counts_[n] == 0)
+        {
+            continue;
+        }
+        out << levelNames[static_cast<std::size_t>(levels_[n])] << ' '
+            << names_[n] << ' ' << std::defaultfloat << sums_[n].speed() << ' '
+            << sums_[n].flow << ' ' << counts_[n] << '\n';
+    }
+}
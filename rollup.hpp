@@ -0,0 +1,72 @@
+#pragma once
+
+#include "aggregate.hpp"
+#include "sitekey.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class RecordBatch;
+
+// Spatial rollups of the per-site rows of a publication (xmline --rollup):
+// flow-weighted harmonic mean speed, total flow and reporting sites per
+// road, per region and for the whole country.
+//
+// Every site gets a dense number whose road (the first word of its
+// measurementSiteName, like N457) and region (its id up to the first
+// underscore, like PZH01) are kept as node numbers. Nodes are stored in
+// parent-index arrays, parents before their children: regions roll up into
+// the country, roads (which cross regions) only stand for themselves. A
+// publication is one pass over the sites into their road and region
+// nodes and one pass over the nodes into their parents.
+
+class SiteRollup
+{
+  public:
+    SiteRollup();
+
+    // Read site names from a measurement site table
+    bool load(const std::string& path);
+
+    // Sum the sites of one publication; sites the table lacks are placed
+    // by id only
+    void build(const SiteAggregate& sites, const RecordBatch& batch);
+
+    // Lines "level name speed flow sites" for every node with a speed or
+    // flow in the publication; sites counts those with a speed
+    void write(std::ostream& out) const;
+
+    [[nodiscard]] std::size_t nodes() const { return names_.size(); }
+
+  private:
+    enum class Level : std::uint8_t
+    {
+        Country,
+        Region,
+        Road
+    };
+
+    static constexpr std::uint32_t noNode = UINT32_MAX;
+
+    std::uint32_t node(Level level, const std::string& name);
+    std::uint32_t site(SiteKey key, const RecordBatch& batch);
+
+    std::unordered_map<SiteKey, std::string> roadNames_; // from the table
+    std::unordered_map<std::string, std::uint32_t> nodeNumbers_;
+
+    // Per site
+    std::unordered_map<SiteKey, std::uint32_t> sites_;
+    std::vector<std::uint32_t> siteRegion_;
+    std::vector<std::uint32_t> siteRoad_; // noNode without a name
+
+    // Per node
+    std::vector<Level> levels_;
+    std::vector<std::string> names_;
+    std::vector<std::uint32_t> parents_; // noNode at the top
+    std::vector<HarmonicSum> sums_;
+    std::vector<std::uint32_t> counts_; // sites with a speed
+};
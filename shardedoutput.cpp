@@ -0,0 +1,221 @@
+#include "shardedoutput.hpp"
+
+#include "feedparser.hpp"
+#include "sitekey.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+constexpr std::size_t putAreaSize = 64 * 1024;
+constexpr std::size_t shardBufferSize = 256 * 1024;
+constexpr std::size_t maxQueuedBuffers = 8; // per shard, bounds memory
+constexpr std::uint64_t shardMix = 0x9E3779B97F4A7C15ULL;
+
+ShardedOutput::ShardedOutput(const std::string& prefix, unsigned int count)
+    : buffer_(putAreaSize)
+{
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        auto shard = std::make_unique<Shard>();
+        shard->path = shardPath(prefix, i);
+        shard->pending.reserve(shardBufferSize);
+        shard->writer = std::thread(writeLoop, std::ref(*shard));
+        shards_.push_back(std::move(shard));
+    }
+}
+
+ShardedOutput::~ShardedOutput()
+{
+    (void)finish();
+}
+
+std::string ShardedOutput::shardPath(const std::string& prefix, unsigned int i)
+{
+    return prefix + "." + std::to_string(i);
+}
+
+std::size_t ShardedOutput::shardOf(std::string_view siteId) const
+{
+    SiteKey key = 0;
+    if (!packSiteId(siteId, key))
+    {
+        key = hashBytes(siteId, 0);
+    }
+    const std::uint64_t mixed = (key * shardMix) >> 32U;
+    return static_cast<std::size_t>((mixed * shards_.size()) >> 32U);
+}
+
+// Lines look like "idx site speed flow"; anything else is broadcast
+void ShardedOutput::route(std::string_view line)
+{
+    const std::size_t first = line.find(' ');
+    const std::size_t second = first == std::string_view::npos
+                                   ? std::string_view::npos
+                                   : line.find(' ', first + 1);
+    if (second == std::string_view::npos)
+    {
+        for (const auto& shard : shards_)
+        {
+            shard->pending += line;
+        }
+        return;
+    }
+    Shard& shard = *shards_[shardOf(line.substr(first + 1, second - first - 1))];
+    shard.pending += line;
+    if (shard.pending.size() >= shardBufferSize)
+    {
+        handOff(shard);
+    }
+}
+
+// Queue the pending buffer for the writer, waiting while the queue is full
+void ShardedOutput::handOff(Shard& shard)
+{
+    if (shard.pending.empty())
+    {
+        return;
+    }
+    std::string full;
+    full.reserve(shardBufferSize);
+    full.swap(shard.pending);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    shard.changed.wait(lock,
+                       [&shard] { return shard.queue.size() < maxQueuedBuffers; });
+    shard.queue.push_back(std::move(full));
+    shard.changed.notify_all();
+}
+
+void ShardedOutput::writeLoop(Shard& shard)
+{
+    // Opened here: opening a FIFO blocks until its consumer is there
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+    const int fd = open(shard.path.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        0644);
+    bool failed = fd < 0;
+    if (failed)
+    {
+        std::cerr << "Failed to open " << shard.path << ".\n";
+    }
+
+    for (;;)
+    {
+        std::string buffer;
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            shard.changed.wait(
+                lock, [&shard] { return !shard.queue.empty() || shard.closing; });
+            if (shard.queue.empty())
+            {
+                break;
+            }
+            buffer = std::move(shard.queue.front());
+            shard.queue.pop_front();
+            shard.changed.notify_all();
+        }
+        // Keep draining after a failure so the producer never blocks
+        std::size_t done = 0;
+        while (!failed && done < buffer.size())
+        {
+            const ssize_t wrote =
+                write(fd, buffer.data() + done, buffer.size() - done);
+            if (wrote < 0 && errno != EINTR)
+            {
+                std::cerr << "Failed to write " << shard.path << ".\n";
+                failed = true;
+            }
+            else if (wrote > 0)
+            {
+                done += static_cast<std::size_t>(wrote);
+            }
+        }
+    }
+
+    if (fd >= 0 && close(fd) != 0)
+    {
+        failed = true;
+    }
+    const std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.failed = failed;
+}
+
+// Route the complete lines of text; keep an incomplete last line
+void ShardedOutput::consume(std::string_view text)
+{
+    std::size_t start = 0;
+    for (std::size_t end = text.find('\n'); end != std::string_view::npos;
+         end = text.find('\n', start))
+    {
+        if (line_.empty())
+        {
+            route(text.substr(start, end + 1 - start));
+        }
+        else
+        {
+            line_ += text.substr(start, end + 1 - start);
+            route(line_);
+            line_.clear();
+        }
+        start = end + 1;
+    }
+    line_ += text.substr(start);
+}
+
+void ShardedOutput::drain()
+{
+    consume({pbase(), static_cast<std::size_t>(pptr() - pbase())});
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+ShardedOutput::int_type ShardedOutput::overflow(int_type c)
+{
+    drain();
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        return traits_type::not_eof(c);
+    }
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+}
+
+int ShardedOutput::sync()
+{
+    drain();
+    for (const auto& shard : shards_)
+    {
+        handOff(*shard);
+    }
+    return 0;
+}
+
+bool ShardedOutput::finish()
+{
+    if (finished_)
+    {
+        return ok_;
+    }
+    finished_ = true;
+    drain();
+    if (!line_.empty())
+    {
+        route(line_);
+        line_.clear();
+    }
+    ok_ = true;
+    for (const auto& shard : shards_)
+    {
+        handOff(*shard);
+        {
+            const std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->closing = true;
+            shard->changed.notify_all();
+        }
+        shard->writer.join();
+        ok_ = ok_ && !shard->failed;
+    }
+    return ok_;
+}
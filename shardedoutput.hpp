@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Stream buffer that splits xmline output into count shard files (or
+// FIFOs) named prefix.0 .. prefix.<count-1>. Measurement lines are routed by
+// a hash of their site key, so every site always lands in the same shard
+// and keeps its order there; lines without a site (publicationTime) go to
+// every shard. Each shard has its own buffer and writer thread.
+class ShardedOutput : public std::streambuf
+{
+  public:
+    ShardedOutput(const std::string& prefix, unsigned int count);
+    ~ShardedOutput() override;
+
+    ShardedOutput(const ShardedOutput&) = delete;
+    ShardedOutput& operator=(const ShardedOutput&) = delete;
+    ShardedOutput(ShardedOutput&&) = delete;
+    ShardedOutput& operator=(ShardedOutput&&) = delete;
+
+    static std::string shardPath(const std::string& prefix, unsigned int i);
+
+    // Shard of a site id
+    [[nodiscard]] std::size_t shardOf(std::string_view siteId) const;
+
+    // Write out everything and stop the writers; false if any write failed
+    bool finish();
+
+  protected:
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+  private:
+    struct Shard
+    {
+        std::string path;
+        std::string pending; // filled by the producer
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::string> queue; // full buffers for the writer
+        bool closing = false;
+        bool failed = false;
+        std::thread writer;
+    };
+
+    void drain();
+    void consume(std::string_view text);
+    void route(std::string_view line);
+    static void handOff(Shard& shard);
+    static void writeLoop(Shard& shard);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<char> buffer_; // put area of the stream
+    std::string line_;         // incomplete last line
+    bool finished_ = false;
+    bool ok_ = true;
+};
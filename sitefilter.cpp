@@ -0,0 +1,113 @@
+#include "sitefilter.hpp"
+
+#include "feedparser.hpp"
+
+#include <fstream>
+
+constexpr std::uint64_t filterSeed = 0x5173F11EULL;
+constexpr std::size_t bitsPerId = 16;
+constexpr std::size_t bitsPerBlock = 512;
+constexpr unsigned int probes = 6;
+constexpr unsigned int probeBits = 9; // log2(bitsPerBlock)
+constexpr std::uint64_t probeMix = 0x9E3779B97F4A7C15ULL;
+
+std::size_t SiteFilter::Hash::operator()(std::string_view id) const
+{
+    return static_cast<std::size_t>(hashBytes(id, filterSeed));
+}
+
+bool SiteFilter::load(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        const std::size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#')
+        {
+            continue;
+        }
+        const std::size_t end = line.find_last_not_of(" \t\r");
+        ids_.insert(line.substr(begin, end - begin + 1));
+    }
+    rebuild();
+    return !in.bad();
+}
+
+void SiteFilter::add(std::string_view id)
+{
+    if (!ids_.insert(std::string(id)).second)
+    {
+        return;
+    }
+    if (ids_.size() * bitsPerId > blocks_.size() * bitsPerBlock)
+    {
+        rebuild();
+    }
+    else
+    {
+        setBits(hashBytes(id, filterSeed));
+    }
+}
+
+// The block comes from the high half of the hash, the probe bits from a
+// remix of all of it
+SiteFilter::Block& SiteFilter::blockOf(std::uint64_t hash)
+{
+    return blocks_[(hash >> 32U) * blocks_.size() >> 32U];
+}
+
+const SiteFilter::Block& SiteFilter::blockOf(std::uint64_t hash) const
+{
+    return blocks_[(hash >> 32U) * blocks_.size() >> 32U];
+}
+
+void SiteFilter::setBits(std::uint64_t hash)
+{
+    Block& block = blockOf(hash);
+    std::uint64_t probe = hash * probeMix;
+    for (unsigned int i = 0; i < probes; ++i)
+    {
+        const auto bit = probe & (bitsPerBlock - 1);
+        block[bit / 64] |= std::uint64_t{1} << (bit % 64);
+        probe >>= probeBits;
+    }
+}
+
+// Size the filter for the current ids and set their bits
+void SiteFilter::rebuild()
+{
+    const std::size_t count =
+        (ids_.size() * bitsPerId + bitsPerBlock - 1) / bitsPerBlock;
+    blocks_.assign(count == 0 ? 1 : count, Block{});
+    for (const std::string& id : ids_)
+    {
+        setBits(hashBytes(id, filterSeed));
+    }
+}
+
+bool SiteFilter::mayContain(std::uint64_t hash) const
+{
+    const Block& block = blockOf(hash);
+    std::uint64_t probe = hash * probeMix;
+    for (unsigned int i = 0; i < probes; ++i)
+    {
+        const auto bit = probe & (bitsPerBlock - 1);
+        if ((block[bit / 64] & (std::uint64_t{1} << (bit % 64))) == 0)
+        {
+            return false;
+        }
+        probe >>= probeBits;
+    }
+    return true;
+}
+
+bool SiteFilter::contains(std::string_view id) const
+{
+    return !blocks_.empty() && mayContain(hashBytes(id, filterSeed)) &&
+           ids_.find(id) != ids_.end();
+}
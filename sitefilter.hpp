@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Set of subscribed site ids. A blocked Bloom filter (one 64-byte block per
+// id, all probe bits inside it) rejects most other ids with a single cache
+// line read; ids that pass are confirmed against the exact set.
+class SiteFilter
+{
+  public:
+    // Read one site id per line; blank lines and lines starting with # are
+    // ignored
+    bool load(const std::string& path);
+
+    void add(std::string_view id);
+
+    [[nodiscard]] bool contains(std::string_view id) const;
+
+    [[nodiscard]] std::size_t size() const { return ids_.size(); }
+
+  private:
+    using Block = std::array<std::uint64_t, 8>;
+
+    struct Hash
+    {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view id) const;
+    };
+
+    void rebuild();
+    void setBits(std::uint64_t hash);
+    Block& blockOf(std::uint64_t hash);
+    [[nodiscard]] const Block& blockOf(std::uint64_t hash) const;
+    [[nodiscard]] bool mayContain(std::uint64_t hash) const;
+
+    std::unordered_set<std::string, Hash, std::equal_to<>> ids_;
+    std::vector<Block> blocks_;
+};
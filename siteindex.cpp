@@ -0,0 +1,163 @@
+#include "siteindex.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+constexpr std::size_t entrySize = 2 * sizeof(std::uint64_t) +
+                                  2 * sizeof(std::uint32_t);
+
+template <typename T> static void putValue(std::string& out, T value)
+{
+    std::array<char, sizeof(T)> bytes{};
+    std::memcpy(bytes.data(), &value, sizeof(T));
+    out.append(bytes.data(), bytes.size());
+}
+
+template <typename T>
+static bool getValue(std::string_view data, std::size_t& pos, T& value)
+{
+    if (pos > data.size() || data.size() - pos < sizeof(T))
+    {
+        return false;
+    }
+    std::memcpy(&value, data.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+std::string siteIndexPath(const std::string& feedPath)
+{
+    return feedPath + ".idx";
+}
+
+bool writeSiteIndex(const std::string& path,
+                    std::uint64_t feedSize,
+                    const std::string& publicationTime,
+                    std::vector<BlockLocation> locations)
+{
+    std::stable_sort(locations.begin(),
+                     locations.end(),
+                     [](const BlockLocation& lhs, const BlockLocation& rhs)
+                     { return lhs.siteId < rhs.siteId; });
+
+    std::string data(siteIndexMagic);
+    putValue(data, feedSize);
+    putValue(data, static_cast<std::uint32_t>(locations.size()));
+    putValue(data, static_cast<std::uint32_t>(publicationTime.size()));
+    data += publicationTime;
+
+    std::string names;
+    for (const BlockLocation& location : locations)
+    {
+        putValue(data, static_cast<std::uint64_t>(location.offset));
+        putValue(data, static_cast<std::uint64_t>(names.size()));
+        putValue(data, static_cast<std::uint32_t>(location.length));
+        putValue(data, static_cast<std::uint32_t>(location.siteId.size()));
+        names += location.siteId;
+    }
+    data += names;
+
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out.flush())
+        {
+            return false;
+        }
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool SiteIndex::open(const std::string& path)
+{
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    const bool loaded = file_.load(fd);
+    (void)close(fd);
+    const std::string_view data = file_.view();
+    if (!loaded || !data.starts_with(siteIndexMagic))
+    {
+        return false;
+    }
+
+    std::size_t pos = siteIndexMagic.size();
+    std::uint32_t count = 0;
+    std::uint32_t timeLength = 0;
+    if (!getValue(data, pos, feedSize_) || !getValue(data, pos, count) ||
+        !getValue(data, pos, timeLength) || data.size() - pos < timeLength)
+    {
+        return false;
+    }
+    publicationTime_ = data.substr(pos, timeLength);
+    pos += timeLength;
+
+    count_ = count;
+    if ((data.size() - pos) / entrySize < count_)
+    {
+        return false;
+    }
+    entries_ = data.substr(pos, count_ * entrySize);
+    names_ = data.substr(pos + entries_.size());
+    return true;
+}
+
+SiteIndex::Entry SiteIndex::entry(std::size_t i) const
+{
+    Entry result = {};
+    std::size_t pos = i * entrySize;
+    (void)getValue(entries_, pos, result.offset);
+    (void)getValue(entries_, pos, result.nameOffset);
+    (void)getValue(entries_, pos, result.length);
+    (void)getValue(entries_, pos, result.nameLength);
+    return result;
+}
+
+std::string_view SiteIndex::name(const Entry& entry) const
+{
+    if (entry.nameOffset > names_.size())
+    {
+        return {};
+    }
+    return names_.substr(entry.nameOffset, entry.nameLength);
+}
+
+std::vector<BlockSpan> SiteIndex::find(std::string_view site) const
+{
+    // Lower bound over the sorted entries
+    std::size_t low = 0;
+    std::size_t high = count_;
+    while (low < high)
+    {
+        const std::size_t mid = low + (high - low) / 2;
+        if (name(entry(mid)) < site)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    std::vector<BlockSpan> spans;
+    for (; low < count_; ++low)
+    {
+        const Entry match = entry(low);
+        if (name(match) != site)
+        {
+            break;
+        }
+        spans.push_back({match.offset, match.offset + match.length});
+    }
+    return spans;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "feedparser.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Sidecar site index of one feed file: for every site the byte range of its
+// <siteMeasurements> block, sorted by site id for binary search.
+//
+// Layout (host byte order): siteIndexMagic, u64 feed size, u32 entry count,
+// u32 publicationTime length, the publicationTime bytes, the entries
+// {u64 offset, u64 name offset, u32 length, u32 name length} and finally
+// the site id string table the name offsets point into.
+
+constexpr std::string_view siteIndexMagic = "XSI1";
+
+// Sidecar path of a feed file
+std::string siteIndexPath(const std::string& feedPath);
+
+// Sort locations by site id and write them next to the feed; the file is
+// replaced atomically
+bool writeSiteIndex(const std::string& path,
+                    std::uint64_t feedSize,
+                    const std::string& publicationTime,
+                    std::vector<BlockLocation> locations);
+
+// Read-only view of a sidecar index
+class SiteIndex
+{
+  public:
+    bool open(const std::string& path);
+
+    [[nodiscard]] std::uint64_t feedSize() const { return feedSize_; }
+
+    [[nodiscard]] std::string_view publicationTime() const
+    {
+        return publicationTime_;
+    }
+
+    // Blocks of site, in document order
+    [[nodiscard]] std::vector<BlockSpan> find(std::string_view site) const;
+
+  private:
+    struct Entry
+    {
+        std::uint64_t offset;
+        std::uint64_t nameOffset;
+        std::uint32_t length;
+        std::uint32_t nameLength;
+    };
+
+    [[nodiscard]] Entry entry(std::size_t i) const;
+    [[nodiscard]] std::string_view name(const Entry& entry) const;
+
+    InputBuffer file_;
+    std::uint64_t feedSize_ = 0;
+    std::size_t count_ = 0;
+    std::string_view publicationTime_;
+    std::string_view entries_;
+    std::string_view names_;
+};
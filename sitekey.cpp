@@ -0,0 +1,320 @@
+#include "sitekey.hpp"
+
+#include <array>
+
+namespace
+{
+
+constexpr unsigned int authorityShift = 41;
+constexpr unsigned int schemeShift = 39;
+constexpr SiteKey bodyMask = (SiteKey{1} << schemeShift) - 1;
+constexpr SiteKey schemeMask = 3;
+constexpr SiteKey authorityMask = (SiteKey{1} << 22U) - 1;
+
+constexpr std::array<std::string_view, 3> schemes = {"MONIBAS", "MST", "MORO"};
+constexpr SiteKey schemeMonibas = 0;
+constexpr SiteKey schemeMst = 1;
+constexpr SiteKey schemeMoro = 2;
+
+// MONIBAS body: road and hectometer, lane, carriageway letter, part
+constexpr unsigned int laneShift = 7;
+constexpr unsigned int positionShift = 12;
+constexpr SiteKey laneHrl = 0;
+constexpr SiteKey laneHrr = 1;
+constexpr SiteKey laneVw = 2; // vwa .. vwz follow
+constexpr SiteKey lastCarriageway = 7;
+
+constexpr SiteKey letters = 26;
+constexpr SiteKey decimal = 10;
+constexpr SiteKey tenThousand = 10000;
+
+// Cursor over an id that consumes fixed-width fields
+class Fields
+{
+  public:
+    explicit Fields(std::string_view text) : text_(text) {}
+
+    bool digits(std::size_t count, SiteKey& value)
+    {
+        if (text_.size() < count)
+        {
+            return false;
+        }
+        value = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const char c = text_[i];
+            if (c < '0' || c > '9')
+            {
+                return false;
+            }
+            value = value * decimal + static_cast<SiteKey>(c - '0');
+        }
+        text_.remove_prefix(count);
+        return true;
+    }
+
+    bool letter(char first, char last, SiteKey& value)
+    {
+        if (text_.empty() || text_.front() < first || text_.front() > last)
+        {
+            return false;
+        }
+        value = static_cast<SiteKey>(text_.front() - first);
+        text_.remove_prefix(1);
+        return true;
+    }
+
+    bool literal(std::string_view word)
+    {
+        if (!text_.starts_with(word))
+        {
+            return false;
+        }
+        text_.remove_prefix(word.size());
+        return true;
+    }
+
+    [[nodiscard]] bool done() const { return text_.empty(); }
+
+  private:
+    std::string_view text_;
+};
+
+bool packMonibas(Fields& fields, SiteKey& body)
+{
+    SiteKey road = 0;
+    SiteKey hecto = 0;
+    SiteKey lane = 0;
+    SiteKey carriageway = 0;
+    SiteKey part = 0;
+    if (!fields.digits(4, road))
+    {
+        return false;
+    }
+    if (fields.literal("hrl"))
+    {
+        lane = laneHrl;
+    }
+    else if (fields.literal("hrr"))
+    {
+        lane = laneHrr;
+    }
+    else if (fields.literal("vw") && fields.letter('a', 'z', lane))
+    {
+        lane += laneVw;
+    }
+    else
+    {
+        return false;
+    }
+    if (!fields.digits(4, hecto) || !fields.literal("r") ||
+        !fields.letter('a', 'z', carriageway) || carriageway > lastCarriageway)
+    {
+        return false;
+    }
+    if (fields.literal("_"))
+    {
+        if (!fields.digits(1, part))
+        {
+            return false;
+        }
+        ++part;
+    }
+    body = ((road * tenThousand + hecto) << positionShift) |
+           (lane << laneShift) | (carriageway << 4U) | part;
+    return fields.done();
+}
+
+void appendDigits(std::string& out, SiteKey value, std::size_t width)
+{
+    std::string digits(width, '0');
+    for (std::size_t i = width; i > 0; --i)
+    {
+        digits[i - 1] = static_cast<char>('0' + value % decimal);
+        value /= decimal;
+    }
+    out += digits;
+}
+
+void unpackMonibas(std::string& out, SiteKey body)
+{
+    const SiteKey position = body >> positionShift;
+    const SiteKey lane = (body >> laneShift) & 0x1fU;
+    const SiteKey carriageway = (body >> 4U) & 0x7U;
+    const SiteKey part = body & 0xfU;
+
+    appendDigits(out, position / tenThousand, 4);
+    if (lane == laneHrl)
+    {
+        out += "hrl";
+    }
+    else if (lane == laneHrr)
+    {
+        out += "hrr";
+    }
+    else
+    {
+        out += "vw";
+        out += static_cast<char>('a' + (lane - laneVw));
+    }
+    appendDigits(out, position % tenThousand, 4);
+    out += 'r';
+    out += static_cast<char>('a' + carriageway);
+    if (part != 0)
+    {
+        out += '_';
+        appendDigits(out, part - 1, 1);
+    }
+}
+
+} // namespace
+
+bool packSiteId(std::string_view id, SiteKey& key)
+{
+    Fields fields(id);
+
+    // Authority: three capitals and a two digit number, e.g. RWS01
+    SiteKey authority = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        SiteKey letter = 0;
+        if (!fields.letter('A', 'Z', letter))
+        {
+            return false;
+        }
+        authority = authority * letters + letter;
+    }
+    SiteKey number = 0;
+    if (!fields.digits(2, number) || !fields.literal("_"))
+    {
+        return false;
+    }
+    authority = (authority << 7U) | number;
+
+    SiteKey scheme = 0;
+    SiteKey body = 0;
+    bool packed = false;
+    for (; scheme < schemes.size(); ++scheme)
+    {
+        // On a copy, so that a scheme without its "_" is not consumed
+        Fields next = fields;
+        if (next.literal(schemes[scheme]) && next.literal("_"))
+        {
+            fields = next;
+            break;
+        }
+    }
+    SiteKey suffix = 0;
+    switch (scheme)
+    {
+    case schemeMonibas:
+        packed = packMonibas(fields, body);
+        break;
+    case schemeMst:
+        packed = fields.digits(4, number) && fields.literal("_") &&
+                 fields.digits(2, suffix) && fields.done();
+        body = number * 100 + suffix;
+        break;
+    case schemeMoro:
+        packed = fields.digits(4, number) && fields.literal("_") &&
+                 fields.digits(1, suffix) && fields.done();
+        body = number * decimal + suffix;
+        break;
+    default:
+        break;
+    }
+    if (!packed)
+    {
+        return false;
+    }
+    key = packedSiteKeyFlag | (authority << authorityShift) |
+          (scheme << schemeShift) | body;
+    return true;
+}
+
+std::string unpackSiteKey(SiteKey key)
+{
+    const SiteKey authority = (key >> authorityShift) & authorityMask;
+    const SiteKey scheme = (key >> schemeShift) & schemeMask;
+    const SiteKey body = key & bodyMask;
+
+    std::string id;
+    const SiteKey word = authority >> 7U;
+    id += static_cast<char>('A' + word / (letters * letters));
+    id += static_cast<char>('A' + word / letters % letters);
+    id += static_cast<char>('A' + word % letters);
+    appendDigits(id, authority & 0x7fU, 2);
+    id += '_';
+    if (scheme >= schemes.size())
+    {
+        return {};
+    }
+    id += schemes[scheme];
+    id += '_';
+    switch (scheme)
+    {
+    case schemeMonibas:
+        unpackMonibas(id, body);
+        break;
+    case schemeMst:
+        appendDigits(id, body / 100, 4);
+        id += '_';
+        appendDigits(id, body % 100, 2);
+        break;
+    default:
+        appendDigits(id, body / decimal, 4);
+        id += '_';
+        appendDigits(id, body % decimal, 1);
+        break;
+    }
+    return id;
+}
+
+SiteKey SiteKeyTable::key(std::string_view id)
+{
+    SiteKey result = 0;
+    if (packSiteId(id, result))
+    {
+        return result;
+    }
+    const std::lock_guard<std::mutex> lock(mutex_);
+    auto [it, inserted] = ids_.try_emplace(std::string(id), names_.size());
+    if (inserted)
+    {
+        names_.emplace_back(id);
+    }
+    return it->second;
+}
+
+bool SiteKeyTable::find(std::string_view id, SiteKey& key) const
+{
+    if (packSiteId(id, key))
+    {
+        return true;
+    }
+    const std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = ids_.find(std::string(id));
+    if (it == ids_.end())
+    {
+        return false;
+    }
+    key = it->second;
+    return true;
+}
+
+std::string SiteKeyTable::name(SiteKey key) const
+{
+    if (isPackedSiteKey(key))
+    {
+        return unpackSiteKey(key);
+    }
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return key < names_.size() ? names_[key] : std::string();
+}
+
+std::size_t SiteKeyTable::interned() const
+{
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return names_.size();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 64-bit keys for NDW measurement site ids.
+//
+// Ids of the common forms are packed into the key itself (bit 63 set):
+//   bits 62..41  authority: three letters (5 bits each) and two digits,
+//                e.g. RWS01
+//   bits 40..39  scheme: MONIBAS, MST or MORO
+//   bits 38..0   scheme specific number and suffix
+// Any other id is interned in a SiteKeyTable and keyed by its table index
+// (bit 63 clear), so every site id maps to a key that round-trips.
+
+using SiteKey = std::uint64_t;
+
+constexpr SiteKey packedSiteKeyFlag = SiteKey{1} << 63U;
+
+[[nodiscard]] inline bool isPackedSiteKey(SiteKey key)
+{
+    return (key & packedSiteKeyFlag) != 0;
+}
+
+// Pack an id of one of the known forms; false for any other id
+bool packSiteId(std::string_view id, SiteKey& key);
+
+// Id of a packed key
+std::string unpackSiteKey(SiteKey key);
+
+// Packs what it can and interns the rest. Thread safe; lookups of packed
+// ids do not lock.
+class SiteKeyTable
+{
+  public:
+    SiteKey key(std::string_view id);
+
+    // Key of an id without interning it; false for unknown unpackable ids
+    bool find(std::string_view id, SiteKey& key) const;
+
+    [[nodiscard]] std::string name(SiteKey key) const;
+
+    // Number of interned (unpackable) ids
+    [[nodiscard]] std::size_t interned() const;
+
+  private:
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, SiteKey> ids_;
+    std::vector<std::string> names_;
+};
@@ -0,0 +1,91 @@
+// Packs every site id of a feed and checks that it unpacks to the same id
+// and that no two ids share a key, then the same for ids that look like a
+// known form but are not. Usage: sitekey_test FEED
+
+#include "sitekey.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+static int failures = 0;
+
+static void check(std::string_view name, bool condition, std::string_view id)
+{
+    if (!condition)
+    {
+        std::cerr << "FAIL " << name << ": " << id << '\n';
+        ++failures;
+    }
+}
+
+// Every id packs to at most one key and back, and keys are not shared
+static void roundTrip(const std::vector<std::string>& ids, std::string_view name)
+{
+    std::unordered_map<SiteKey, std::string> seen;
+    for (const std::string& id : ids)
+    {
+        SiteKey key = 0;
+        if (!packSiteId(id, key))
+        {
+            continue;
+        }
+        check(name, unpackSiteKey(key) == id, id);
+        const auto [found, added] = seen.emplace(key, id);
+        check(name, added || found->second == id, id);
+    }
+    if (failures == 0)
+    {
+        std::cout << "ok " << name << '\n';
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: sitekey_test FEED\n";
+        return 1;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    const std::string feed((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+    if (!in && !in.eof())
+    {
+        std::cerr << "Failed to read " << argv[1] << ".\n";
+        return 1;
+    }
+
+    constexpr std::string_view marker = "measurementSiteReference id=\"";
+    std::vector<std::string> ids;
+    for (std::size_t at = feed.find(marker); at != std::string::npos;
+         at = feed.find(marker, at))
+    {
+        at += marker.size();
+        ids.emplace_back(feed.substr(at, feed.find('"', at) - at));
+    }
+    check("feed ids", ids.size() > 1000, argv[1]);
+    roundTrip(ids, "feed ids");
+
+    // A scheme name followed by anything but "_" is not that scheme
+    roundTrip({"RWS01_MSTMORO_1234_5",
+               "RWS01_MORO_1234_5",
+               "RWS01_MST_1234_56",
+               "RWS01_MSTX_1234_56",
+               "RWS01_MONIBASMST_1234_56",
+               "RWS01_MONIBAS_0020hrl0256ra",
+               "RWS01_MONIBAS_0020hrl0256ra_1",
+               "RWS01_MONIBAS_0020vwb0256rb",
+               "PZH01_MST_0029_00",
+               "GRT01_MORO_0001_0"},
+              "look-alike ids");
+    SiteKey key = 0;
+    check("look-alike ids",
+          !packSiteId("RWS01_MSTMORO_1234_5", key),
+          "RWS01_MSTMORO_1234_5");
+    return failures == 0 ? 0 : 1;
+}
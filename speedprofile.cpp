@@ -0,0 +1,434 @@
+#include "speedprofile.hpp"
+#include "records.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr std::uint32_t initialProfileCapacity = 4096;
+constexpr std::uint64_t tableMix = 0x9E3779B97F4A7C15ULL;
+
+struct SpeedProfile::Header
+{
+    std::array<char, 4> magic;
+    std::uint32_t slots;
+    std::uint32_t capacity;
+    std::uint32_t sites;
+    std::uint32_t tableSize;
+    float alpha;
+    std::uint64_t reserved;
+};
+
+struct ProfileLayout
+{
+    std::size_t keys;
+    std::size_t rows;
+    std::size_t means;
+    std::size_t counts;
+    std::size_t size;
+};
+
+static ProfileLayout profileLayout(std::uint32_t capacity,
+                                   std::uint32_t tableSize)
+{
+    constexpr std::size_t headerSize = 32;
+    const std::size_t cells = std::size_t{capacity} * profileSlots;
+    ProfileLayout layout{};
+    layout.keys = headerSize;
+    layout.rows = layout.keys + sizeof(SiteKey) * tableSize;
+    layout.means = layout.rows + sizeof(std::uint32_t) * tableSize;
+    layout.counts = layout.means + sizeof(float) * cells;
+    layout.size = layout.counts + sizeof(std::uint32_t) * cells;
+    return layout;
+}
+
+// Key 0 marks a free table entry
+static SiteKey storedKey(SiteKey site)
+{
+    return site == 0 ? 1 : site;
+}
+
+std::uint32_t profileSlot(std::int64_t ms)
+{
+    constexpr std::int64_t msPerSecond = 1000;
+    constexpr int daysPerWeek = 7;
+    constexpr int slotsPerHour = 4;
+    constexpr int minutesPerSlot = 15;
+    const auto seconds = static_cast<std::time_t>(ms / msPerSecond);
+    std::tm local = {};
+    (void)localtime_r(&seconds, &local);
+    const int day = (local.tm_wday + daysPerWeek - 1) % daysPerWeek;
+    return static_cast<std::uint32_t>(
+        ((day * 24) + local.tm_hour) * slotsPerHour +
+        local.tm_min / minutesPerSlot);
+}
+
+// Write an empty profile to path
+static bool createProfile(const std::string& path,
+                          std::uint32_t capacity,
+                          float alpha)
+{
+    const std::uint32_t tableSize = capacity * 2;
+    const ProfileLayout layout = profileLayout(capacity, tableSize);
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                          0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    void* data = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(layout.size)) == 0)
+    {
+        data = mmap(nullptr,
+                    layout.size,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED,
+                    fd,
+                    0);
+    }
+    (void)close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    char* bytes = static_cast<char*>(data);
+    std::array<char, 4> magic{};
+    std::copy(profileMagic.begin(), profileMagic.end(), magic.begin());
+    std::memcpy(bytes, magic.data(), magic.size());
+    const std::array<std::uint32_t, 4> counts = {
+        profileSlots, capacity, 0, tableSize};
+    std::memcpy(bytes + magic.size(), counts.data(), sizeof(counts));
+    std::memcpy(bytes + magic.size() + sizeof(counts), &alpha, sizeof(alpha));
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    float* means = reinterpret_cast<float*>(bytes + layout.means);
+    std::fill_n(means,
+                std::size_t{capacity} * profileSlots,
+                std::numeric_limits<float>::quiet_NaN());
+    return munmap(data, layout.size) == 0;
+}
+
+SpeedProfile::~SpeedProfile()
+{
+    if (writable_)
+    {
+        (void)sync();
+    }
+    unmap();
+}
+
+void SpeedProfile::unmap()
+{
+    if (data_ != nullptr)
+    {
+        (void)munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
+
+bool SpeedProfile::map(const std::string& path, bool writable)
+{
+    unmap();
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+    const int fd = ::open(path.c_str(),
+                          (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat info = {};
+    void* data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= 32)
+    {
+        data = mmap(nullptr,
+                    static_cast<std::size_t>(info.st_size),
+                    writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                    MAP_SHARED,
+                    fd,
+                    0);
+    }
+    (void)close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    data_ = data;
+    size_ = static_cast<std::size_t>(info.st_size);
+    writable_ = writable;
+    device_ = info.st_dev;
+    inode_ = info.st_ino;
+    path_ = path;
+
+    const Header& head = header();
+    const bool valid =
+        std::string_view(head.magic.data(), head.magic.size()) ==
+            profileMagic &&
+        head.slots == profileSlots && head.sites <= head.capacity &&
+        head.tableSize >= head.capacity && head.tableSize != 0 &&
+        (head.tableSize & (head.tableSize - 1)) == 0 &&
+        profileLayout(head.capacity, head.tableSize).size == size_;
+    if (!valid)
+    {
+        unmap();
+    }
+    return valid;
+}
+
+bool SpeedProfile::open(const std::string& path, bool writable, float alpha)
+{
+    struct stat info = {};
+    if (writable && stat(path.c_str(), &info) != 0 && errno == ENOENT)
+    {
+        const std::string tmp = path + ".tmp";
+        if (!createProfile(tmp, initialProfileCapacity, alpha) ||
+            std::rename(tmp.c_str(), path.c_str()) != 0)
+        {
+            return false;
+        }
+    }
+    return map(path, writable);
+}
+
+SpeedProfile::Header& SpeedProfile::header() const
+{
+    static_assert(sizeof(Header) == 32, "profileLayout assumes this");
+    return *static_cast<Header*>(data_);
+}
+
+SiteKey* SpeedProfile::keys() const
+{
+    const ProfileLayout layout =
+        profileLayout(header().capacity, header().tableSize);
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    return reinterpret_cast<SiteKey*>(static_cast<char*>(data_) + layout.keys);
+}
+
+std::uint32_t* SpeedProfile::rows() const
+{
+    const ProfileLayout layout =
+        profileLayout(header().capacity, header().tableSize);
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    return reinterpret_cast<std::uint32_t*>(static_cast<char*>(data_) +
+                                            layout.rows);
+}
+
+float* SpeedProfile::means() const
+{
+    const ProfileLayout layout =
+        profileLayout(header().capacity, header().tableSize);
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    return reinterpret_cast<float*>(static_cast<char*>(data_) + layout.means);
+}
+
+std::uint32_t* SpeedProfile::counts() const
+{
+    const ProfileLayout layout =
+        profileLayout(header().capacity, header().tableSize);
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    return reinterpret_cast<std::uint32_t*>(static_cast<char*>(data_) +
+                                            layout.counts);
+}
+
+// Key of a table slot. Keys are published with a release store after their
+// row, so a reader of the mapping that sees a key also sees its row.
+static SiteKey loadKey(SiteKey& slot)
+{
+    return std::atomic_ref<SiteKey>(slot).load(std::memory_order_acquire);
+}
+
+// Table position holding key, or the free position where it would go
+std::size_t SpeedProfile::find(SiteKey key) const
+{
+    const std::size_t mask = header().tableSize - 1;
+    std::uint64_t hash = key * tableMix;
+    hash ^= hash >> 29U;
+    std::size_t pos = static_cast<std::size_t>(hash) & mask;
+    SiteKey* table = keys();
+    for (SiteKey stored = loadKey(table[pos]); stored != 0 && stored != key;
+         stored = loadKey(table[pos]))
+    {
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+std::int64_t SpeedProfile::rowOf(SiteKey site) const
+{
+    if (data_ == nullptr)
+    {
+        return -1;
+    }
+    const SiteKey key = storedKey(site);
+    const std::size_t pos = find(key);
+    return loadKey(keys()[pos]) == key ? std::int64_t{rows()[pos]} : -1;
+}
+
+float SpeedProfile::reference(SiteKey site, std::uint32_t slot) const
+{
+    const std::int64_t row = rowOf(site);
+    if (row < 0 || slot >= profileSlots)
+    {
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+    return means()[static_cast<std::size_t>(row) * profileSlots + slot];
+}
+
+std::uint32_t SpeedProfile::observations(SiteKey site,
+                                         std::uint32_t slot) const
+{
+    const std::int64_t row = rowOf(site);
+    if (row < 0 || slot >= profileSlots)
+    {
+        return 0;
+    }
+    return counts()[static_cast<std::size_t>(row) * profileSlots + slot];
+}
+
+std::uint32_t SpeedProfile::sites() const
+{
+    return data_ == nullptr ? 0 : header().sites;
+}
+
+bool SpeedProfile::update(SiteKey site, std::uint32_t slot, float speed)
+{
+    if (!writable_ || slot >= profileSlots)
+    {
+        return false;
+    }
+    const SiteKey key = storedKey(site);
+    std::size_t pos = find(key);
+    if (keys()[pos] != key)
+    {
+        if (header().sites == header().capacity)
+        {
+            if (!grow())
+            {
+                return false;
+            }
+            pos = find(key);
+        }
+        rows()[pos] = header().sites++;
+        std::atomic_ref<SiteKey>(keys()[pos])
+            .store(key, std::memory_order_release);
+    }
+
+    const std::size_t cell = std::size_t{rows()[pos]} * profileSlots + slot;
+    std::uint32_t& count = counts()[cell];
+    float& mean = means()[cell];
+    if (count < std::numeric_limits<std::uint32_t>::max())
+    {
+        ++count;
+    }
+    const float weight =
+        std::max(header().alpha, 1.0F / static_cast<float>(count));
+    mean = std::isnan(mean) ? speed : mean + weight * (speed - mean);
+    return true;
+}
+
+bool SpeedProfile::update(const RecordBatch& batch)
+{
+    bool ok = true;
+    std::int64_t slotTime = std::numeric_limits<std::int64_t>::min();
+    std::uint32_t slot = 0;
+    const std::size_t rows = batch.size();
+    std::size_t begin = 0;
+    while (begin < rows)
+    {
+        // The rows of one block share site and time
+        std::size_t end = begin + 1;
+        while (end < rows && batch.site[end] == batch.site[begin] &&
+               batch.time[end] == batch.time[begin])
+        {
+            ++end;
+        }
+        double sum = 0;
+        std::size_t valid = 0;
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            if (batch.speed[i] >= 0)
+            {
+                sum += batch.speed[i];
+                ++valid;
+            }
+        }
+        if (valid > 0)
+        {
+            if (batch.time[begin] != slotTime)
+            {
+                slotTime = batch.time[begin];
+                slot = profileSlot(slotTime);
+            }
+            ok = update(batch.site[begin],
+                        slot,
+                        static_cast<float>(sum / static_cast<double>(valid))) &&
+                 ok;
+        }
+        begin = end;
+    }
+    return ok;
+}
+
+// Move every site into a file twice the size and put it in place of the old
+bool SpeedProfile::grow()
+{
+    const std::uint32_t capacity = header().capacity * 2;
+    const std::string tmp = path_ + ".tmp";
+    SpeedProfile next;
+    if (!createProfile(tmp, capacity, header().alpha) || !next.map(tmp, true))
+    {
+        return false;
+    }
+    const SiteKey* table = keys();
+    for (std::size_t pos = 0; pos < header().tableSize; ++pos)
+    {
+        if (table[pos] == 0)
+        {
+            continue;
+        }
+        const std::size_t at = next.find(table[pos]);
+        const std::uint32_t row = next.header().sites++;
+        next.keys()[at] = table[pos];
+        next.rows()[at] = row;
+        const std::size_t from = std::size_t{rows()[pos]} * profileSlots;
+        const std::size_t to = std::size_t{row} * profileSlots;
+        std::copy_n(means() + from, profileSlots, next.means() + to);
+        std::copy_n(counts() + from, profileSlots, next.counts() + to);
+    }
+    if (!next.sync() || std::rename(tmp.c_str(), path_.c_str()) != 0)
+    {
+        return false;
+    }
+
+    unmap();
+    data_ = next.data_;
+    size_ = next.size_;
+    device_ = next.device_;
+    inode_ = next.inode_;
+    next.data_ = nullptr;
+    next.writable_ = false;
+    return true;
+}
+
+bool SpeedProfile::sync()
+{
+    return !writable_ || data_ == nullptr || msync(data_, size_, MS_SYNC) == 0;
+}
+
+bool SpeedProfile::stale() const
+{
+    struct stat info = {};
+    return stat(path_.c_str(), &info) != 0 || info.st_dev != device_ ||
+           info.st_ino != inode_;
+}
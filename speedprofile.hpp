@@ -0,0 +1,93 @@
+#pragma once
+
+#include "sitekey.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+class RecordBatch;
+
+// Reference ("normal") speed per site and 15-minute slot of the week, kept
+// online as an exponentially decayed mean of observed speeds. The file is
+// the table itself, mapped shared, so a daemon that maps it sees every
+// update and looks a site up in O(1).
+//
+// Layout (host byte order): profileMagic, u32 slots, u32 capacity (rows),
+// u32 sites (rows in use), u32 table size (power of two), f32 alpha, u64
+// reserved; then an open-addressing table of u64 site keys (0 = empty) and
+// u32 rows, a key stored only after its row; then f32 means
+// [capacity][profileSlots] (NaN = never observed) and u32 observation
+// counts of the same shape. Site keys are those of recordSiteKey. A writer that runs out of rows writes a file twice the
+// size and renames it over the old one; readers notice with stale().
+
+constexpr std::string_view profileMagic = "XSP1";
+constexpr std::uint32_t profileSlots = 7 * 24 * 4;
+
+// Weight of a new observation once a slot has more than 1/alpha of them;
+// before that the slot holds the plain mean. With a publication a minute a
+// slot sees 15 observations a week, so this averages over about a month.
+constexpr float defaultProfileAlpha = 1.0F / 64;
+
+// Slot of the week of a time in ms since the epoch, in local time (TZ),
+// counted from Monday 00:00
+std::uint32_t profileSlot(std::int64_t ms);
+
+class SpeedProfile
+{
+  public:
+    SpeedProfile() = default;
+    ~SpeedProfile();
+
+    SpeedProfile(const SpeedProfile&) = delete;
+    SpeedProfile& operator=(const SpeedProfile&) = delete;
+    SpeedProfile(SpeedProfile&&) = delete;
+    SpeedProfile& operator=(SpeedProfile&&) = delete;
+
+    // Map a profile; a writable profile is created when path does not exist
+    bool open(const std::string& path,
+              bool writable,
+              float alpha = defaultProfileAlpha);
+
+    // Reference speed of a site in a slot; NaN when it was never observed
+    [[nodiscard]] float reference(SiteKey site, std::uint32_t slot) const;
+
+    [[nodiscard]] std::uint32_t observations(SiteKey site,
+                                             std::uint32_t slot) const;
+
+    // Fold one speed into a slot; false when the file could not grow
+    bool update(SiteKey site, std::uint32_t slot, float speed);
+
+    // Fold in the mean valid (non-negative) speed of every block of batch
+    bool update(const RecordBatch& batch);
+
+    bool sync();
+
+    // Whether a writer replaced the file since it was opened
+    [[nodiscard]] bool stale() const;
+
+    [[nodiscard]] std::uint32_t sites() const;
+
+  private:
+    struct Header;
+
+    [[nodiscard]] Header& header() const;
+    [[nodiscard]] std::size_t find(SiteKey key) const;
+    [[nodiscard]] SiteKey* keys() const;
+    [[nodiscard]] std::uint32_t* rows() const;
+    [[nodiscard]] float* means() const;
+    [[nodiscard]] std::uint32_t* counts() const;
+    [[nodiscard]] std::int64_t rowOf(SiteKey site) const;
+    bool map(const std::string& path, bool writable);
+    void unmap();
+    bool grow();
+
+    std::string path_;
+    void* data_ = nullptr;
+    std::size_t size_ = 0;
+    bool writable_ = false;
+    dev_t device_ = 0;
+    ino_t inode_ = 0;
+};
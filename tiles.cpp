@@ -0,0 +1,181 @@
+#include "tiles.hpp"
+#include "records.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <numbers>
+#include <thread>
+#include <tuple>
+
+// Web Mercator tile of a point at zoom
+static void tileOf(double lat,
+                   double lon,
+                   unsigned int zoom,
+                   std::uint32_t& x,
+                   std::uint32_t& y)
+{
+    const double n = std::ldexp(1.0, static_cast<int>(zoom));
+    const double latRad = lat * std::numbers::pi / 180;
+    const double fx = (lon + 180) / 360 * n;
+    const double fy =
+        (1 - std::asinh(std::tan(latRad)) / std::numbers::pi) / 2 * n;
+    x = static_cast<std::uint32_t>(std::clamp(fx, 0.0, n - 1));
+    y = static_cast<std::uint32_t>(std::clamp(fy, 0.0, n - 1));
+}
+
+template <typename T> static void append(std::string& out, T value)
+{
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-reinterpret-cast]
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+bool TileCache::build(const std::vector<SitePlacement>& sites,
+                      const std::string& dir,
+                      unsigned int minZoom,
+                      unsigned int maxZoom)
+{
+    std::map<std::tuple<unsigned int, std::uint32_t, std::uint32_t>,
+             std::vector<std::uint32_t>>
+        tiles;
+    for (const SitePlacement& site : sites)
+    {
+        if (!site.placed || site.id.empty())
+        {
+            continue;
+        }
+        const auto [found, added] = rows_.try_emplace(
+            recordSiteKey(site.id), static_cast<std::uint32_t>(ids_.size()));
+        if (!added)
+        {
+            continue;
+        }
+        ids_.push_back(site.id);
+        latitude_.push_back(static_cast<float>(site.point.lat));
+        longitude_.push_back(static_cast<float>(site.point.lon));
+        for (unsigned int zoom = minZoom; zoom <= maxZoom; ++zoom)
+        {
+            std::uint32_t x = 0;
+            std::uint32_t y = 0;
+            tileOf(site.point.lat, site.point.lon, zoom, x, y);
+            tiles[{zoom, x, y}].push_back(found->second);
+        }
+    }
+    speed_.assign(ids_.size(), -1);
+    flow_.assign(ids_.size(), 0);
+    writtenSpeed_ = speed_;
+    writtenFlow_ = flow_;
+
+    for (auto& [key, members] : tiles)
+    {
+        const auto& [zoom, x, y] = key;
+        const std::filesystem::path column =
+            std::filesystem::path(dir) / std::to_string(zoom) /
+            std::to_string(x);
+        std::error_code error;
+        std::filesystem::create_directories(column, error);
+        if (!std::filesystem::is_directory(column))
+        {
+            return false;
+        }
+        tiles_.push_back(
+            Tile{(column / (std::to_string(y) + ".xtl")).string(),
+                 std::move(members)});
+    }
+    return true;
+}
+
+void TileCache::clear()
+{
+    std::ranges::fill(speed_, -1.0F);
+    std::ranges::fill(flow_, 0);
+}
+
+void TileCache::set(SiteKey site, double speed, std::int64_t flow)
+{
+    const auto found = rows_.find(site);
+    if (found != rows_.end())
+    {
+        speed_[found->second] = static_cast<float>(speed);
+        flow_[found->second] = static_cast<std::int32_t>(
+            std::min<std::int64_t>(flow, std::numeric_limits<std::int32_t>::max()));
+    }
+}
+
+bool TileCache::changed(const Tile& tile) const
+{
+    return !tile.written ||
+           std::ranges::any_of(tile.sites,
+                               [this](std::uint32_t row)
+                               {
+                                   return speed_[row] != writtenSpeed_[row] ||
+                                          flow_[row] != writtenFlow_[row];
+                               });
+}
+
+bool TileCache::writeTile(Tile& tile) const
+{
+    std::string payload(tileMagic);
+    append(payload, static_cast<std::uint32_t>(tile.sites.size()));
+    for (const std::uint32_t row : tile.sites)
+    {
+        append(payload, latitude_[row]);
+        append(payload, longitude_[row]);
+        append(payload, speed_[row]);
+        append(payload, flow_[row]);
+        const std::string& id = ids_[row];
+        const auto length = static_cast<std::uint16_t>(
+            std::min<std::size_t>(id.size(), UINT16_MAX));
+        append(payload, length);
+        payload.append(id, 0, length);
+    }
+
+    // Until the rename succeeds the file may not match the written snapshot
+    tile.written = false;
+    const std::string tmp = tile.path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        if (!out.flush())
+        {
+            return false;
+        }
+    }
+    tile.written = std::rename(tmp.c_str(), tile.path.c_str()) == 0;
+    return tile.written;
+}
+
+bool TileCache::write(unsigned int threads)
+{
+    std::atomic<bool> failed = false;
+    auto work = [this, threads, &failed](unsigned int first)
+    {
+        for (std::size_t i = first; i < tiles_.size(); i += threads)
+        {
+            if (changed(tiles_[i]) && !writeTile(tiles_[i]))
+            {
+                failed = true;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; ++t)
+    {
+        workers.emplace_back(work, t);
+    }
+    work(0);
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    // Tiles that failed stay unwritten and are retried after the next
+    // publication
+    writtenSpeed_ = speed_;
+    writtenFlow_ = flow_;
+    return !failed;
+}
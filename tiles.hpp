@@ -0,0 +1,72 @@
+#pragma once
+
+#include "mapmatch.hpp"
+#include "sitekey.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Map tiles of current site speeds (xmline --tiles DIR), so a web map reads
+// a file per tile instead of querying per request.
+//
+// The tile list is built once from the site coordinates: every placed site
+// goes into its Web Mercator tile (XYZ numbering) at each served zoom
+// level. After a publication, every tile with a site whose speed or flow
+// changed is rendered and written to DIR/z/x/y.xtl through a temporary file
+// and a rename, so a reader never sees a partial tile. Tiles are spread
+// over threads workers.
+//
+// Payload, host byte order: tileMagic, u32 sites, then per site f32
+// latitude, f32 longitude, f32 speed (-1 when the site reported none), i32
+// flow, u16 id length and the id.
+
+constexpr std::string_view tileMagic = "XTL1";
+constexpr unsigned int defaultTileMinZoom = 8;
+constexpr unsigned int defaultTileMaxZoom = 14;
+constexpr unsigned int maxTileZoom = 22;
+
+class TileCache
+{
+  public:
+    // Place sites into the tiles of zoom levels minZoom..maxZoom and create
+    // their directories under dir
+    bool build(const std::vector<SitePlacement>& sites,
+               const std::string& dir,
+               unsigned int minZoom,
+               unsigned int maxZoom);
+
+    // Start a publication: every site is without data until set
+    void clear();
+
+    void set(SiteKey site, double speed, std::int64_t flow);
+
+    // Write the tiles whose sites changed since they were last written
+    bool write(unsigned int threads);
+
+    [[nodiscard]] std::size_t tiles() const { return tiles_.size(); }
+
+  private:
+    struct Tile
+    {
+        std::string path;
+        std::vector<std::uint32_t> sites;
+        bool written = false;
+    };
+
+    [[nodiscard]] bool changed(const Tile& tile) const;
+    bool writeTile(Tile& tile) const;
+
+    std::unordered_map<SiteKey, std::uint32_t> rows_;
+    std::vector<std::string> ids_;
+    std::vector<float> latitude_;
+    std::vector<float> longitude_;
+    std::vector<float> speed_;
+    std::vector<std::int32_t> flow_;
+    std::vector<float> writtenSpeed_; // as last written
+    std::vector<std::int32_t> writtenFlow_;
+    std::vector<Tile> tiles_;
+};
@@ -0,0 +1,134 @@
+#include "trackerstate.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct TrackerState::Header
+{
+    std::array<char, 4> magic;
+    std::uint32_t entrySize;
+    std::uint64_t entries;
+    std::uint32_t publication;
+    std::uint32_t reserved;
+};
+
+constexpr std::size_t trackerHeaderSize = 24;
+
+// Write an empty table to path; ftruncate leaves the entries zero
+static bool createState(const std::string& path,
+                        std::string_view magic,
+                        std::size_t entrySize,
+                        std::size_t entries)
+{
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                          0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    std::array<char, trackerHeaderSize> head{};
+    std::copy(magic.begin(), magic.end(), head.begin());
+    const auto size = static_cast<std::uint32_t>(entrySize);
+    const auto count = static_cast<std::uint64_t>(entries);
+    std::memcpy(head.data() + magic.size(), &size, sizeof(size));
+    std::memcpy(head.data() + magic.size() + sizeof(size), &count, sizeof(count));
+    const auto fileSize =
+        static_cast<off_t>(trackerHeaderSize + entrySize * entries);
+    const bool ok = write(fd, head.data(), head.size()) ==
+                        static_cast<ssize_t>(head.size()) &&
+                    ftruncate(fd, fileSize) == 0;
+    return close(fd) == 0 && ok;
+}
+
+TrackerState::~TrackerState()
+{
+    (void)sync();
+    unmap();
+}
+
+void TrackerState::unmap()
+{
+    if (data_ != nullptr)
+    {
+        (void)munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
+
+bool TrackerState::open(const std::string& path,
+                        std::string_view magic,
+                        std::size_t entrySize,
+                        std::size_t entries)
+{
+    static_assert(sizeof(Header) == trackerHeaderSize, "layout assumes this");
+    unmap();
+    struct stat info = {};
+    if (stat(path.c_str(), &info) != 0 && errno == ENOENT)
+    {
+        const std::string tmp = path + ".tmp";
+        if (!createState(tmp, magic, entrySize, entries) ||
+            std::rename(tmp.c_str(), path.c_str()) != 0)
+        {
+            return false;
+        }
+    }
+
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+    const int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    const std::size_t size = trackerHeaderSize + entrySize * entries;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && static_cast<std::size_t>(info.st_size) == size)
+    {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    (void)close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    data_ = data;
+    size_ = size;
+
+    const Header& head = header();
+    const bool valid =
+        std::string_view(head.magic.data(), head.magic.size()) == magic &&
+        head.entrySize == entrySize && head.entries == entries;
+    if (!valid)
+    {
+        unmap();
+    }
+    return valid;
+}
+
+TrackerState::Header& TrackerState::header() const
+{
+    return *static_cast<Header*>(data_);
+}
+
+void* TrackerState::entries() const
+{
+    return static_cast<char*>(data_) + trackerHeaderSize;
+}
+
+std::uint32_t& TrackerState::publication() const
+{
+    return header().publication;
+}
+
+bool TrackerState::sync()
+{
+    return data_ == nullptr || msync(data_, size_, MS_SYNC) == 0;
+}
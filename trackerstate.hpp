@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Fixed-size table of a tracker that follows detectors across publications
+// (DetectorHealth, SpeedImputer), kept in a file mapped shared so that a
+// run per publication carries on where the last one stopped.
+//
+// Layout (host byte order): 4-byte magic, u32 entry size, u64 entries, u32
+// publication counter, u32 reserved; then the entries, all zero bytes in a
+// new file. A file of another magic, entry size or count is refused rather
+// than reinterpreted. One writer at a time.
+class TrackerState
+{
+  public:
+    TrackerState() = default;
+    ~TrackerState();
+
+    TrackerState(const TrackerState&) = delete;
+    TrackerState& operator=(const TrackerState&) = delete;
+    TrackerState(TrackerState&&) = delete;
+    TrackerState& operator=(TrackerState&&) = delete;
+
+    // Map path, created when it does not exist; false when it cannot be
+    // created or mapped or was written for another table
+    bool open(const std::string& path,
+              std::string_view magic,
+              std::size_t entrySize,
+              std::size_t entries);
+
+    [[nodiscard]] bool mapped() const { return data_ != nullptr; }
+
+    // First entry, right after the header
+    [[nodiscard]] void* entries() const;
+
+    [[nodiscard]] std::uint32_t& publication() const;
+
+    bool sync();
+
+  private:
+    struct Header;
+
+    [[nodiscard]] Header& header() const;
+    void unmap();
+
+    void* data_ = nullptr;
+    std::size_t size_ = 0;
+};
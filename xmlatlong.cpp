@@ -0,0 +1,62 @@
+#include "extractor.hpp"
+#include "feedparser.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <libxml/parser.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// C++ counterpart of clatlong built on the generated extractor: reads a
+// measurement site table on stdin and prints the publicationTime, then
+// "site versionTime latitude longitude" for every coordinate pair.
+
+using SiteTable =
+    Extractor<"measurementSiteRecord",
+              DocumentField<"publicationTime", std::string>,
+              Field<"measurementSiteRecord", std::string, "id">,
+              Field<"measurementSiteRecordVersionTime", std::string>,
+              Field<"latitude", std::vector<double>>,
+              Field<"longitude", std::vector<double>>>;
+
+int main()
+{
+    xmlTextReaderPtr reader =
+        xmlReaderForFd(STDIN_FILENO, "stdin", nullptr, xmlReaderOptions());
+    if (reader == nullptr)
+    {
+        std::cerr << "Failed to create XML reader.\n";
+        return 1;
+    }
+
+    SiteTable table;
+    bool header = false;
+    table.run(reader,
+              [&header](const SiteTable::Values& values)
+              {
+                  const auto& [time, site, version, latitudes, longitudes] =
+                      values;
+                  if (!header && !time.empty())
+                  {
+                      std::cout << time << '\n';
+                      header = true;
+                  }
+                  const char* id =
+                      site.empty() ? "(unknown_site)" : site.c_str();
+                  const char* date =
+                      version.empty() ? "(unknown_date)" : version.c_str();
+                  const std::size_t pairs =
+                      std::min(latitudes.size(), longitudes.size());
+                  for (std::size_t i = 0; i < pairs; ++i)
+                  {
+                      std::cout << id << ' ' << date << ' ' << latitudes[i]
+                                << ' ' << longitudes[i] << '\n';
+                  }
+              });
+
+    xmlFreeTextReader(reader);
+    xmlCleanupParser();
+    return 0;
+}
@@ -1,270 +1,905 @@
+#include "feedparser.hpp"
+#include "aggregate.hpp"
+#include "health.hpp"
+#include "impute.hpp"
+#include "mapmatch.hpp"
+#include "packformat.hpp"
+#include "records.hpp"
+#include "rollup.hpp"
+#include "shardedoutput.hpp"
+#include "sitefilter.hpp"
+#include "speedprofile.hpp"
+#include "siteindex.hpp"
+#include "tiles.hpp"
 
 #include <algorithm>
-#include <cmath>
-#include <cstdint>
+#include <cerrno>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
-#include <deque>
-#include <iomanip>
+#include <fcntl.h>
+#include <fstream>
 #include <iostream>
+#include <libxml/parser.h>
 #include <libxml/xmlreader.h>
-#include <libxml/xmlstring.h>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
-// Compare libxml2 xmlChar* local name with a C string
-static inline bool nameIs(const xmlChar* local, const char* key)
+// Configure stdout buffering (8 MiB). Return true on success.
+static inline bool configureStdoutBuffering()
 {
-    // NOLINTBEGIN[cppcoreguidelines-pro-type-reinterpret-cast]
-    return local != nullptr &&
-           (xmlStrEqual(local, reinterpret_cast<const xmlChar*>(key)) != 0);
-    // NOLINTEND[cppcoreguidelines-pro-type-reinterpret-cast]
+    constexpr std::size_t eightMB = 8 * 1024 * 1024;
+    return std::setvbuf(stdout, nullptr, _IOFBF, eightMB) == 0;
 }
 
-// Read element text as long (vehicleFlowRate) without any casts
-static inline bool readElementLong(xmlTextReaderPtr reader, long& out)
-{
-    xmlChar* txt = xmlTextReaderReadString(reader);
-    if (txt == nullptr)
-    {
-        return false;
-    }
+constexpr auto followPoll = std::chrono::milliseconds(50);
+constexpr auto followIdleLimit = std::chrono::seconds(30);
 
-    const auto len = static_cast<size_t>(xmlStrlen(txt));
-    std::string str(len, '\0');
-    std::copy_n(txt, len, str.begin());
-    xmlFree(txt);
+// Feed a file, pipe or socket to doc as data arrives. A regular file that
+// is still being written is polled until its root element is closed or it
+// stops growing for followIdleLimit.
+static bool followInput(int fd, IncrementalDocument& doc)
+{
+    struct stat info = {};
+    const bool regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
 
-    char* end = nullptr;
-    const unsigned int decimal = 10;
-    long value = std::strtol(str.c_str(), &end, decimal);
-    if (end == str.c_str())
+    constexpr std::size_t chunkSize = 64 * 1024;
+    std::vector<char> chunk(chunkSize);
+    auto lastData = std::chrono::steady_clock::now();
+    for (;;)
     {
-        return false;
+        const ssize_t got = read(fd, chunk.data(), chunk.size());
+        if (got < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        if (got > 0)
+        {
+            doc.feed({chunk.data(), static_cast<std::size_t>(got)});
+            std::cout.flush();
+            lastData = std::chrono::steady_clock::now();
+            continue;
+        }
+
+        // A skipped document will not complete, there is nothing to wait for
+        if (!regular || doc.complete() || doc.skipped())
+        {
+            break;
+        }
+        if (std::chrono::steady_clock::now() - lastData > followIdleLimit)
+        {
+            std::cerr << "Input stopped growing before the document ended.\n";
+            break;
+        }
+        std::this_thread::sleep_for(followPoll);
     }
-    out = value;
+    doc.finish();
     return true;
 }
 
-// Read element text as double (speed: supports floats)
-static inline bool readElementDouble(xmlTextReaderPtr reader, double& out)
+struct Options
 {
-    xmlChar* txt = xmlTextReaderReadString(reader);
-    if (txt == nullptr)
-    {
-        return false;
-    }
+    bool memo = false;
+    bool stats = false;
+    bool follow = false;
+    bool index = false;
+    bool binary = false;
+    bool sortSites = false;
+    unsigned int threads = 1;
+    std::string dedupIndex;
+    std::string sitesFile;
+    unsigned int shards = 0;
+    std::string shardPrefix = "xmline-shard";
+    ColumnSet columns; // empty: the default idx site speed flow lines
+    std::string profile;
+    std::string health;      // detector health event log
+    std::string healthState; // detector runs kept across runs
+    bool impute = false;
+    std::string neighbours;  // site table for --impute
+    std::string imputeState; // detector history kept across runs
+    std::string aggregate;  // site table for per-site rows
+    std::string match;      // xmlmatch cache for per-segment rows
+    bool rollup = false;    // road, region and country rows
+    std::string tiles;      // map tile directory
+    unsigned int tileMinZoom = defaultTileMinZoom;
+    unsigned int tileMaxZoom = defaultTileMaxZoom;
+    std::vector<std::string> files;
+};
 
-    const auto len = static_cast<size_t>(xmlStrlen(txt));
-    std::string str(len, '\0');
-    std::copy_n(txt, len, str.begin());
-    xmlFree(txt);
+constexpr unsigned long maxThreads = 256;
+constexpr unsigned long maxShards = 1024;
 
-    char* end = nullptr;
-    double value = std::strtod(str.c_str(), &end);
-    if (end == str.c_str())
+static bool parseOptions(int argc, char* argv[], Options& opts)
+{
+    for (int i = 1; i < argc; ++i)
     {
-        return false;
+        const std::string_view arg = argv[i];
+        if (arg == "--memo")
+        {
+            opts.memo = true;
+        }
+        else if (arg == "--stats")
+        {
+            opts.stats = true;
+        }
+        else if (arg == "--follow")
+        {
+            opts.follow = true;
+        }
+        else if (arg == "--index")
+        {
+            opts.index = true;
+        }
+        else if (arg == "--binary")
+        {
+            opts.binary = true;
+        }
+        else if (arg == "--sort-sites")
+        {
+            opts.sortSites = true;
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            char* end = nullptr;
+            const unsigned int decimal = 10;
+            const unsigned long count = std::strtoul(argv[++i], &end, decimal);
+            if (*end != '\0' || count == 0 || count > maxThreads)
+            {
+                return false;
+            }
+            opts.threads = static_cast<unsigned int>(count);
+        }
+        else if (arg == "--dedup" && i + 1 < argc)
+        {
+            opts.dedupIndex = argv[++i];
+        }
+        else if (arg == "--sites" && i + 1 < argc)
+        {
+            opts.sitesFile = argv[++i];
+        }
+        else if (arg == "--shards" && i + 1 < argc)
+        {
+            char* end = nullptr;
+            const unsigned int decimal = 10;
+            const unsigned long count = std::strtoul(argv[++i], &end, decimal);
+            if (*end != '\0' || count == 0 || count > maxShards)
+            {
+                return false;
+            }
+            opts.shards = static_cast<unsigned int>(count);
+        }
+        else if (arg == "--shard-out" && i + 1 < argc)
+        {
+            opts.shardPrefix = argv[++i];
+        }
+        else if (arg == "--profile" && i + 1 < argc)
+        {
+            opts.profile = argv[++i];
+        }
+        else if (arg == "--health" && i + 1 < argc)
+        {
+            opts.health = argv[++i];
+        }
+        else if (arg == "--health-state" && i + 1 < argc)
+        {
+            opts.healthState = argv[++i];
+        }
+        else if (arg == "--impute")
+        {
+            opts.impute = true;
+        }
+        else if (arg == "--neighbours" && i + 1 < argc)
+        {
+            opts.impute = true;
+            opts.neighbours = argv[++i];
+        }
+        else if (arg == "--impute-state" && i + 1 < argc)
+        {
+            opts.impute = true;
+            opts.imputeState = argv[++i];
+        }
+        else if (arg == "--aggregate" && i + 1 < argc)
+        {
+            opts.aggregate = argv[++i];
+        }
+        else if (arg == "--match" && i + 1 < argc)
+        {
+            opts.match = argv[++i];
+        }
+        else if (arg == "--rollup")
+        {
+            opts.rollup = true;
+        }
+        else if (arg == "--tiles" && i + 1 < argc)
+        {
+            opts.tiles = argv[++i];
+        }
+        else if (arg == "--tile-zooms" && i + 1 < argc)
+        {
+            // MIN-MAX, like 8-14
+            char* end = nullptr;
+            const unsigned int decimal = 10;
+            const unsigned long minZoom = std::strtoul(argv[++i], &end, decimal);
+            if (*end != '-')
+            {
+                return false;
+            }
+            const unsigned long maxZoom = std::strtoul(end + 1, &end, decimal);
+            if (*end != '\0' || minZoom > maxZoom || maxZoom > maxTileZoom)
+            {
+                return false;
+            }
+            opts.tileMinZoom = static_cast<unsigned int>(minZoom);
+            opts.tileMaxZoom = static_cast<unsigned int>(maxZoom);
+        }
+        else if (arg == "--columns" && i + 1 < argc)
+        {
+            if (!opts.columns.parse(argv[++i]))
+            {
+                return false;
+            }
+        }
+        else if (arg.starts_with("--"))
+        {
+            return false;
+        }
+        else
+        {
+            opts.files.emplace_back(arg);
+        }
     }
-    out = value;
     return true;
 }
 
-static inline bool readElementString(xmlTextReaderPtr reader, std::string& out)
+// Open an input argument; "-" is stdin. Returns -1 on failure.
+static int openInput(const std::string& path)
 {
-    xmlChar* txt = xmlTextReaderReadString(reader);
-    if (txt == nullptr)
+    if (path == "-")
     {
-        out.clear();
-        return false;
+        return fileno(stdin);
     }
-
-    const auto len = static_cast<size_t>(xmlStrlen(txt));
-    out.resize(len);
-    if (len > 0)
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
     {
-        std::copy_n(txt, len, out.begin());
+        std::cerr << "Failed to open " << path << ".\n";
     }
-
-    xmlFree(txt);
-    return true;
+    return fd;
 }
 
-static inline bool
-readAttribute(xmlTextReaderPtr reader, const char* name, std::string& out)
+// Read the publication key from the first bytes of a regular file without
+// moving its offset; false for pipes and other unseekable input
+static bool peekPublicationKey(int fd, PublicationKey& key)
 {
-    // NOLINTBEGIN[cppcoreguidelines-pro-type-reinterpret-cast]
-    xmlChar* val = xmlTextReaderGetAttribute(
-        reader, reinterpret_cast<const xmlChar*>(name));
-    // NOLINTEND[cppcoreguidelines-pro-type-reinterpret-cast]
-    if (val == nullptr)
+    struct stat info = {};
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
     {
-        out.clear();
         return false;
     }
-    const auto len = static_cast<size_t>(xmlStrlen(val));
-    out.resize(len);
-    if (len > 0)
+    std::string head(publicationHeadSize, '\0');
+    const ssize_t got = pread(fd, head.data(), head.size(), 0);
+    if (got < 0)
     {
-        std::copy_n(val, len, out.begin());
+        return false;
     }
-    xmlFree(val);
+    head.resize(static_cast<std::size_t>(got));
+    (void)(isPacked(head) ? scanPackedPublicationKey(head, key)
+                          : scanPublicationKey(head, key));
     return true;
 }
 
-// Configure stdout buffering (8 MiB). Return true on success.
-static inline bool configureStdoutBuffering()
+static bool isRegularFile(int fd)
 {
-    constexpr std::size_t eightMB = 8 * 1024 * 1024;
-    return std::setvbuf(stdout, nullptr, _IOFBF, eightMB) == 0;
+    struct stat info = {};
+    return fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
 }
 
-// Build libxml2 options as unsigned to satisfy hicpp-signed-bitwise
-static inline int xmlReaderOptions()
+// Read the first bytes of unseekable input, as many as the packed magic
+// has; false on a read error
+static bool readHead(int fd, std::string& head)
 {
-    constexpr unsigned int optsUnsigned =
-        static_cast<unsigned int>(XML_PARSE_NOERROR) |
-        static_cast<unsigned int>(XML_PARSE_NOWARNING) |
-        static_cast<unsigned int>(XML_PARSE_NOBLANKS);
-    return static_cast<int>(optsUnsigned);
+    head.resize(packMagic.size());
+    std::size_t got = 0;
+    while (got < head.size())
+    {
+        const ssize_t n = read(fd, head.data() + got, head.size() - got);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            head.resize(got);
+            return n == 0;
+        }
+        got += static_cast<std::size_t>(n);
+    }
+    return true;
 }
 
-struct ParserState
+// True when fd is a regular file holding a packed document
+static bool isPackedFile(int fd)
 {
-    std::string siteId;
-    std::deque<double> speeds;
-    std::deque<long> flows;
-    unsigned int idx = 1;
-
-    void resetBlock()
+    struct stat info = {};
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
     {
-        siteId.clear();
-        speeds.clear();
-        flows.clear();
-        idx = 1;
+        return false;
     }
+    std::string head(packMagic.size(), '\0');
+    return pread(fd, head.data(), head.size(), 0) ==
+               static_cast<ssize_t>(head.size()) &&
+           isPacked(head);
+}
+
+// Descriptor whose first bytes were already read
+struct HeadedInput
+{
+    int fd;
+    std::string_view head;
+};
 
-    void flushPairs()
+static int readHeaded(void* context, char* buffer, int len)
+{
+    auto* input = static_cast<HeadedInput*>(context);
+    if (!input->head.empty())
+    {
+        const std::size_t n =
+            std::min(input->head.size(), static_cast<std::size_t>(len));
+        std::copy_n(input->head.data(), n, buffer);
+        input->head.remove_prefix(n);
+        return static_cast<int>(n);
+    }
+    for (;;)
     {
-        const char* site = siteId.empty() ? "(unknown_site)" : siteId.c_str();
-        while (!speeds.empty() && !flows.empty())
+        const ssize_t got = read(input->fd, buffer, static_cast<std::size_t>(len));
+        if (got >= 0 || errno != EINTR)
         {
-            double speed = speeds.front();
-            speeds.pop_front();
-            long flow = flows.front();
-            flows.pop_front();
-            std::cout << idx++ << ' ' << site << ' ' << std::defaultfloat
-                      << speed << ' ' << flow << '\n';
+            return static_cast<int>(got);
         }
     }
+}
+
+// head holds the bytes already read from fd; state carries the output
+// settings (filter, format) of the batch
+static bool processStream(int fd,
+                          const std::string& name,
+                          std::string_view head,
+                          ParserState state)
+{
+    // Create a pull reader directly from the descriptor
+    HeadedInput input{fd, head};
+    xmlTextReaderPtr reader = xmlReaderForIO(readHeaded,
+                                             nullptr, // fd is closed by main
+                                             &input,
+                                             name.c_str(),
+                                             nullptr, // autodetect encoding
+                                             xmlReaderOptions());
+    if (reader == nullptr)
+    {
+        std::cerr << "Failed to create XML reader.\n";
+        return false;
+    }
+
+    state.out = &std::cout;
+    processReader(reader, state);
+    xmlFreeTextReader(reader);
+    return true;
+}
+
+// State shared by all inputs of one run
+struct Batch
+{
+    Options opts;
+    BlockMemo memo;
+    SiteFilter sites;
+    std::vector<BlockEngine> engines;
+    std::vector<RecordBatch> records; // per engine, with --sort-sites
+    SpeedProfile profile;
+    std::unique_ptr<DetectorHealth> health;
+    std::ofstream healthLog;
+    std::unique_ptr<SpeedImputer> imputer;
+    std::vector<char> sources; // imputation flag per row
+    SiteLayout layout;
+    SiteAggregate aggregate;
+    SegmentProjection segments;
+    SiteRollup rollup;
+    std::unique_ptr<TileCache> tiles;
+    PublicationIndex index;
 };
 
-static inline bool handleStartElement(xmlTextReaderPtr reader,
-                                      const xmlChar* localName,
-                                      ParserState& state)
+static void reportDuplicate(const std::string& path, const PublicationKey& key)
+{
+    std::cerr << "Skipped " << path << ": publication " << key.publicationTime
+              << " (table version " << key.tableVersion
+              << ") was already processed.\n";
+}
+
+// Write the rows all engines collected for one input, sorted by site with
+// --sort-sites, after folding their speeds into the --profile and tracking
+// them for --health; with --impute missing speeds are filled and flagged,
+// with --aggregate the rows of each site are reduced to one (and handed to
+// the --tiles cache), with --match the sites of each road segment and with
+// --rollup those of each road and region. A failed stage is reported here.
+static bool writeRecords(Batch& batch)
 {
-    if (nameIs(localName, "publicationTime"))
+    std::vector<RecordBatch>& records = batch.records;
+    RecordBatch& all = records.front();
+    for (std::size_t i = 1; i < records.size(); ++i)
+    {
+        all.append(records[i]);
+        records[i].clear();
+    }
+    const bool ok = batch.opts.profile.empty() || batch.profile.update(all);
+    if (!ok)
+    {
+        std::cerr << "Failed to update profile " << batch.opts.profile << ".\n";
+    }
+    if (batch.health)
     {
-        std::string time;
-        if (readElementString(reader, time))
+        batch.health->update(all, batch.healthLog);
+        batch.healthLog.flush();
+    }
+    if (batch.opts.sortSites)
+    {
+        all.sortBySite();
+    }
+    if (batch.imputer)
+    {
+        batch.imputer->update(all, batch.sources);
+    }
+    if (batch.opts.aggregate.empty() && batch.opts.match.empty())
+    {
+        all.write(std::cout, batch.sources);
+    }
+    else
+    {
+        SiteAggregate& sites = batch.aggregate;
+        sites.build(all, batch.layout);
+        if (batch.tiles)
         {
-            std::cout << time << '\n';
+            batch.tiles->clear();
+            for (std::size_t i = 0; i < sites.size(); ++i)
+            {
+                batch.tiles->set(sites.site[i], sites.speed[i], sites.flow[i]);
+            }
+        }
+        if (batch.opts.rollup)
+        {
+            batch.rollup.build(sites, all);
+            batch.rollup.write(std::cout);
+        }
+        else if (batch.opts.match.empty())
+        {
+            sites.write(std::cout, all);
+        }
+        else
+        {
+            for (std::size_t i = 0; i < sites.size(); ++i)
+            {
+                batch.segments.add(sites.site[i], sites.sum(i));
+            }
+            batch.segments.write(std::cout);
         }
-        return true;
     }
+    all.clear();
+    return ok;
+}
 
-    if (nameIs(localName, "siteMeasurements"))
+// Write the sidecar site index of a feed parsed in block mode
+static bool writeIndex(const std::string& path,
+                       std::string_view document,
+                       std::vector<BlockEngine>& engines)
+{
+    PublicationKey key;
+    (void)scanPublicationKey(document.substr(0, publicationHeadSize), key);
+    std::vector<BlockLocation> locations;
+    for (BlockEngine& engine : engines)
     {
-        state.resetBlock();
-        return true;
+        locations.insert(locations.end(),
+                         std::make_move_iterator(engine.locations.begin()),
+                         std::make_move_iterator(engine.locations.end()));
+        engine.locations.clear();
     }
+    return writeSiteIndex(siteIndexPath(path),
+                          document.size(),
+                          key.publicationTime,
+                          std::move(locations));
+}
 
-    if (nameIs(localName, "measurementSiteReference"))
+static bool processInput(int fd, const std::string& path, Batch& batch)
+{
+    const Options& opts = batch.opts;
+    const bool dedup = !opts.dedupIndex.empty();
+    // A site filter skips whole blocks unparsed and --columns without
+    // either flow or speed data cuts that data out of each block before it
+    // is parsed, so both prefer block mode
+    const ColumnSet& columns = opts.columns;
+    const bool projected = !columns.order.empty() &&
+                           !(columns.flow && columns.speedData());
+    const bool blockMode = opts.memo || opts.stats || opts.index ||
+                           opts.threads > 1 || opts.follow ||
+                           !opts.sitesFile.empty() || projected;
+
+    // Unseekable input is checked incrementally once its header arrived
+    PublicationKey key;
+    bool incremental = opts.follow;
+    if (dedup && !incremental)
     {
-        (void)readAttribute(reader, "id", state.siteId);
-        return true;
+        if (!peekPublicationKey(fd, key))
+        {
+            incremental = true;
+        }
+        else if (batch.index.contains(key))
+        {
+            reportDuplicate(path, key);
+            return true;
+        }
     }
 
-    if (nameIs(localName, "speed"))
+    // Unseekable input is told apart by its first bytes, which are read
+    // here and put in front of the rest
+    std::string head;
+    const bool packed = isPackedFile(fd) ||
+                        (!incremental && !isRegularFile(fd) &&
+                         readHead(fd, head) && isPacked(head));
+
+    bool ok = true;
+    if (packed)
+    {
+        InputBuffer input;
+        ParserState state = batch.engines.front().state;
+        state.out = &std::cout;
+        ok = input.load(fd, head) && replayPacked(input.view(), state);
+    }
+    else if (incremental)
     {
-        double speed = NAN;
-        if (readElementDouble(reader, speed))
+        IncrementalDocument doc(batch.engines.front(), std::cout);
+        if (dedup)
+        {
+            doc.setHeaderCheck(
+                [&batch, &key](const PublicationKey& header)
+                {
+                    key = header;
+                    return !batch.index.contains(header);
+                });
+        }
+        ok = followInput(fd, doc);
+        if (doc.skipped())
         {
-            state.speeds.push_back(speed);
-            state.flushPairs();
+            reportDuplicate(path, key);
+            return true;
         }
-        return true;
     }
-
-    if (nameIs(localName, "vehicleFlowRate"))
+    else if (blockMode)
     {
-        long rate = 0;
-        if (readElementLong(reader, rate))
+        InputBuffer input;
+        ok = input.load(fd, head);
+        if (ok)
         {
-            state.flows.push_back(rate);
-            state.flushPairs();
+            processDocument(input.view(),
+                            batch.engines,
+                            opts.memo ? &batch.memo : nullptr,
+                            std::cout);
+        }
+        if (ok && opts.index &&
+            !writeIndex(path, input.view(), batch.engines))
+        {
+            std::cerr << "Failed to write " << siteIndexPath(path) << ".\n";
         }
-        return true;
+    }
+    else
+    {
+        ok = processStream(fd, path, head, batch.engines.front().state);
     }
 
-    return false;
+    if (!ok)
+    {
+        std::cerr << "Failed to read " << path << ".\n";
+    }
+    else if (dedup && !batch.index.add(key))
+    {
+        std::cerr << "Failed to update " << opts.dedupIndex << ".\n";
+    }
+    return ok;
 }
 
-static inline bool handleEndElement(const xmlChar* localName,
-                                    ParserState& state)
+int main(int argc, char* argv[])
 {
-    if (nameIs(localName, "siteMeasurements"))
+    Batch batch;
+    Options& opts = batch.opts;
+    if (!parseOptions(argc, argv, opts))
     {
-        state.flushPairs(); // flush remaining matched pairs for this block
-        state.resetBlock(); // drop leftovers without match
-        return true;
+        std::cerr << "Usage: xmline [--memo] [--stats] [--threads N] [--follow] "
+                     "[--dedup INDEX] [--index] [--sites FILE] [--shards N] "
+                     "[--shard-out PREFIX] [--binary] [--sort-sites] "
+                     "[--columns speed,flow,stddev,inputs] [--profile FILE] "
+                     "[--health FILE] [--health-state FILE] [--impute] "
+                     "[--neighbours SITETABLE] [--impute-state FILE] "
+                     "[--aggregate SITETABLE] [--match CACHE] [--tiles DIR] "
+                     "[--tile-zooms MIN-MAX] [--rollup] [FILE|DIR...]\n";
+        return 1;
+    }
+    opts.files = expandInputs(opts.files);
+    if (opts.files.empty())
+    {
+        opts.files.emplace_back("-");
     }
-    return false;
-}
 
-static inline void processReader(xmlTextReaderPtr reader, ParserState& state)
-{
-    while (xmlTextReaderRead(reader) == 1)
+    if (opts.index && (opts.follow || std::ranges::count(opts.files, "-") > 0))
+    {
+        std::cerr << "--index needs regular input files.\n";
+        return 1;
+    }
+
+    if (opts.binary && (opts.shards > 0 || opts.sortSites))
+    {
+        std::cerr << "--binary cannot be combined with --shards or "
+                     "--sort-sites.\n";
+        return 1;
+    }
+
+    if (!opts.columns.order.empty() && (opts.binary || opts.sortSites))
+    {
+        std::cerr << "--columns cannot be combined with --binary or "
+                     "--sort-sites.\n";
+        return 1;
+    }
+
+    if ((!opts.profile.empty() || !opts.health.empty() || opts.impute ||
+         !opts.aggregate.empty() || !opts.match.empty()) &&
+        (opts.binary || !opts.columns.order.empty()))
+    {
+        std::cerr << "--profile, --health, --impute, --aggregate and --match "
+                     "cannot be combined with --binary or --columns.\n";
+        return 1;
+    }
+
+    if (!opts.healthState.empty() && opts.health.empty())
+    {
+        std::cerr << "--health-state needs --health FILE.\n";
+        return 1;
+    }
+
+    // Shards are routed on the site of each line, which per-site and
+    // per-segment lines do not carry in the same field
+    if (opts.shards > 0 && (!opts.aggregate.empty() || !opts.match.empty()))
     {
-        const int nodeType = xmlTextReaderNodeType(reader);
-        const xmlChar* localName = xmlTextReaderConstLocalName(reader);
+        std::cerr << "--shards cannot be combined with --aggregate, --match "
+                     "or --rollup.\n";
+        return 1;
+    }
 
-        if (nodeType == XML_READER_TYPE_ELEMENT)
+    if (!opts.match.empty() && opts.aggregate.empty())
+    {
+        std::cerr << "--match needs --aggregate SITETABLE for the lanes and "
+                     "vehicle classes.\n";
+        return 1;
+    }
+
+    if (!opts.tiles.empty() && opts.aggregate.empty())
+    {
+        std::cerr << "--tiles needs --aggregate SITETABLE for the site "
+                     "coordinates.\n";
+        return 1;
+    }
+
+    if (opts.rollup && (opts.aggregate.empty() || !opts.match.empty()))
+    {
+        std::cerr << "--rollup needs --aggregate SITETABLE for the site "
+                     "names and cannot be combined with --match.\n";
+        return 1;
+    }
+
+    if (!configureStdoutBuffering())
+    {
+        std::cerr << "Failed to create outstream buffer.\n";
+        return 1;
+    }
+    if (!opts.dedupIndex.empty() && !batch.index.open(opts.dedupIndex))
+    {
+        std::cerr << "Failed to read " << opts.dedupIndex << ".\n";
+        return 1;
+    }
+    if (!opts.sitesFile.empty() && !batch.sites.load(opts.sitesFile))
+    {
+        std::cerr << "Failed to read " << opts.sitesFile << ".\n";
+        return 1;
+    }
+    if (!opts.profile.empty() && !batch.profile.open(opts.profile, true))
+    {
+        std::cerr << "Failed to open profile " << opts.profile << ".\n";
+        return 1;
+    }
+    if (!opts.health.empty())
+    {
+        batch.healthLog.open(opts.health, std::ios::app);
+        if (!batch.healthLog)
         {
-            (void)handleStartElement(reader, localName, state);
+            std::cerr << "Failed to open " << opts.health << ".\n";
+            return 1;
         }
-        else if (nodeType == XML_READER_TYPE_END_ELEMENT)
+        batch.health = std::make_unique<DetectorHealth>();
+        if (!opts.healthState.empty() &&
+            !batch.health->open(opts.healthState))
         {
-            (void)handleEndElement(localName, state);
+            std::cerr << "Failed to open health state " << opts.healthState
+                      << ".\n";
+            return 1;
         }
     }
-}
-
-int main()
-{
-    if (!configureStdoutBuffering())
+    if (!opts.aggregate.empty() && !batch.layout.load(opts.aggregate))
     {
-        std::cerr << "Failed to create outstream buffer.\n";
+        std::cerr << "Failed to read " << opts.aggregate << ".\n";
         return 1;
     }
+    if (!opts.tiles.empty())
+    {
+        xmlTextReaderPtr reader = xmlReaderForFile(
+            opts.aggregate.c_str(), nullptr, xmlReaderOptions());
+        if (reader == nullptr)
+        {
+            std::cerr << "Failed to read " << opts.aggregate << ".\n";
+            return 1;
+        }
+        std::vector<SitePlacement> sites;
+        const bool read = readSitePlacements(reader, sites);
+        xmlFreeTextReader(reader);
+        if (!read)
+        {
+            std::cerr << "Failed to read " << opts.aggregate << ".\n";
+            return 1;
+        }
+        batch.tiles = std::make_unique<TileCache>();
+        if (!batch.tiles->build(
+                sites, opts.tiles, opts.tileMinZoom, opts.tileMaxZoom))
+        {
+            std::cerr << "Failed to create tile directories in " << opts.tiles
+                      << ".\n";
+            return 1;
+        }
+    }
+    if (opts.rollup && !batch.rollup.load(opts.aggregate))
+    {
+        std::cerr << "Failed to read " << opts.aggregate << ".\n";
+        return 1;
+    }
+    if (!opts.match.empty() && !batch.segments.load(opts.match))
+    {
+        std::cerr << "Failed to read match cache " << opts.match << ".\n";
+        return 1;
+    }
+    if (opts.impute)
+    {
+        batch.imputer = std::make_unique<SpeedImputer>();
+        if (!opts.neighbours.empty() &&
+            !batch.imputer->loadNeighbours(opts.neighbours))
+        {
+            std::cerr << "Failed to read " << opts.neighbours << ".\n";
+            return 1;
+        }
+        if (!opts.imputeState.empty() &&
+            !batch.imputer->open(opts.imputeState))
+        {
+            std::cerr << "Failed to open impute state " << opts.imputeState
+                      << ".\n";
+            return 1;
+        }
+    }
+
+    xmlInitParser();
+    batch.engines = std::vector<BlockEngine>(opts.threads);
+    if (opts.memo)
+    {
+        for (BlockEngine& engine : batch.engines)
+        {
+            engine.memo = &batch.memo;
+        }
+    }
+    // Rows are collected per input when they are sorted, profiled, checked
+    // for detector health, imputed, aggregated or projected onto segments
+    const bool collect = opts.sortSites || !opts.profile.empty() ||
+                         !opts.health.empty() || opts.impute ||
+                         !opts.aggregate.empty() || !opts.match.empty();
+    batch.records = std::vector<RecordBatch>(collect ? opts.threads : 0);
+    for (std::size_t i = 0; i < batch.records.size(); ++i)
+    {
+        batch.engines[i].state.batch = &batch.records[i];
+    }
+    for (BlockEngine& engine : batch.engines)
+    {
+        engine.recordLocations = opts.index;
+        engine.state.filter = opts.sitesFile.empty() ? nullptr : &batch.sites;
+        engine.state.binary = opts.binary;
+        engine.state.columns =
+            opts.columns.order.empty() ? nullptr : &opts.columns;
+    }
 
-    const int options = xmlReaderOptions();
+    // Binary records of each input are sorted before they reach stdout
+    std::unique_ptr<SortedRecordBuffer> sorter;
+    std::streambuf* stdoutBuffer = nullptr;
+    if (opts.binary)
+    {
+        std::cout << recordMagic;
+        sorter = std::make_unique<SortedRecordBuffer>(std::cout.rdbuf());
+        stdoutBuffer = std::cout.rdbuf(sorter.get());
+    }
 
-    // Create a pull reader directly from stdin
-    xmlTextReaderPtr reader = xmlReaderForFd(fileno(stdin),
-                                             "stdin",
-                                             nullptr, // autodetect encoding
-                                             options);
+    // Sharded output replaces the stdout buffer, so every mode writes to it
+    std::unique_ptr<ShardedOutput> sharded;
+    if (opts.shards > 0)
+    {
+        sharded = std::make_unique<ShardedOutput>(opts.shardPrefix, opts.shards);
+        stdoutBuffer = std::cout.rdbuf(sharded.get());
+    }
 
-    if (reader == nullptr)
+    int status = 0;
+    for (const std::string& path : opts.files)
     {
-        std::cerr << "Failed to create XML reader.\n";
-        return 1;
+        const int fd = openInput(path);
+        if (fd < 0)
+        {
+            status = 1;
+            continue;
+        }
+        if (!processInput(fd, path, batch))
+        {
+            status = 1;
+        }
+        if (!batch.records.empty() && !writeRecords(batch))
+        {
+            status = 1;
+        }
+        if (batch.tiles && !batch.tiles->write(opts.threads))
+        {
+            std::cerr << "Failed to write tiles of " << path << ".\n";
+            status = 1;
+        }
+        if (sorter && !sorter->endRun())
+        {
+            std::cerr << "Failed to write records of " << path << ".\n";
+            status = 1;
+        }
+        if (fd != fileno(stdin))
+        {
+            (void)close(fd);
+        }
     }
 
-    ParserState state;
-    processReader(reader, state);
+    if (opts.stats)
+    {
+        BlockStats total;
+        for (const BlockEngine& engine : batch.engines)
+        {
+            total += engine.stats;
+        }
+        std::cout.flush();
+        total.report(std::cerr);
+    }
+
+    if (stdoutBuffer != nullptr)
+    {
+        std::cout.flush();
+        std::cout.rdbuf(stdoutBuffer);
+    }
+    if (sharded && !sharded->finish())
+    {
+        status = 1;
+    }
+    if (!opts.profile.empty() && !batch.profile.sync())
+    {
+        std::cerr << "Failed to write profile " << opts.profile << ".\n";
+        status = 1;
+    }
 
-    xmlFreeTextReader(reader);
     xmlCleanupParser();
-    return 0;
+    return status;
 }
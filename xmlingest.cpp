@@ -0,0 +1,818 @@
+#include "feedparser.hpp"
+#include "httpfetch.hpp"
+#include "sitefilter.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstdlib>
+#include <curl/curl.h>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <libxml/parser.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Ingestion of several feeds in one process. Every feed of the config file
+// is a coroutine looping over three steps on its own interval:
+//   fetch  on the reactor thread, which drives every transfer through the
+//          libcurl multi socket interface over epoll,
+//   parse  on the worker pool: the body is inflated and parsed a slice at a
+//          time, and after every slice the feed queues up again behind the
+//          other feeds, so a large document cannot starve them,
+//   sink   on the worker pool: the output is appended to the feed's file
+//          and, once written, its conditional-fetch state saved.
+// Config lines are "name kind interval url output": kind "measurements"
+// writes xmline lines, kind "raw" stores the inflated document as is (for
+// situation or VMS feeds); interval is in seconds. The --sites filter is
+// shared by all feeds; each feed keeps its own --memo, because a memo
+// forgets what the last publication of its feed did not contain.
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t sliceSize = 64 * 1024; // compressed bytes per turn
+constexpr int maxEvents = 64;
+
+// Coroutine that starts at once and frees its frame when its body ends
+struct FeedTask
+{
+    struct promise_type
+    {
+        FeedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Worker threads resuming coroutines in FIFO order
+class TaskPool
+{
+  public:
+    explicit TaskPool(unsigned int threads)
+    {
+        for (unsigned int t = 0; t < threads; ++t)
+        {
+            workers_.emplace_back([this] { work(); });
+        }
+    }
+
+    ~TaskPool()
+    {
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        ready_.notify_all();
+        for (std::thread& worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+    TaskPool(TaskPool&&) = delete;
+    TaskPool& operator=(TaskPool&&) = delete;
+
+    // Continue on a worker, behind everything queued so far; awaited again
+    // between slices of work it yields to the other feeds
+    auto schedule()
+    {
+        struct Awaiter
+        {
+            TaskPool& pool;
+
+            [[nodiscard]] bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                pool.push(handle);
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+  private:
+    void push(std::coroutine_handle<> handle)
+    {
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(handle);
+        }
+        ready_.notify_one();
+    }
+
+    void work()
+    {
+        for (;;)
+        {
+            std::coroutine_handle<> handle;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (queue_.empty())
+                {
+                    return;
+                }
+                handle = queue_.front();
+                queue_.pop_front();
+            }
+            handle.resume();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::coroutine_handle<>> queue_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
+
+enum class FetchResult
+{
+    Body,
+    NotModified,
+    Failed
+};
+
+struct Feed
+{
+    std::string name;
+    bool raw = false;
+    std::chrono::seconds interval{0};
+    std::string url;
+    std::string output;
+    std::string statePath; // empty: state is not kept between runs
+    PollState state;       // of the last processed publication
+    bool failed = false;   // the last poll failed
+    BlockMemo memo;
+    BlockEngine engine;
+
+    // Current transfer, touched only on the reactor thread
+    CURL* easy = nullptr;
+    curl_slist* headers = nullptr;
+    std::coroutine_handle<> waiting;
+    FetchResult result = FetchResult::Failed;
+    PollState received; // validators of the response
+    std::string body;   // as sent, usually gzip
+};
+
+static std::size_t
+onBody(char* data, std::size_t size, std::size_t count, void* user)
+{
+    auto* feed = static_cast<Feed*>(user);
+    feed->body.append(data, size * count);
+    return size * count;
+}
+
+static std::size_t
+onHeader(char* data, std::size_t size, std::size_t count, void* user)
+{
+    auto* feed = static_cast<Feed*>(user);
+    const std::size_t bytes = size * count;
+    const std::string_view line(data, bytes);
+    if (std::string etag = headerValue(line, "etag"); !etag.empty())
+    {
+        feed->received.etag = std::move(etag);
+    }
+    if (std::string modified = headerValue(line, "last-modified");
+        !modified.empty())
+    {
+        feed->received.lastModified = std::move(modified);
+    }
+    return bytes;
+}
+
+// One thread multiplexing every transfer and timer over epoll. Coroutines
+// awaiting a transfer or a timer are resumed on it.
+class Reactor
+{
+  public:
+    Reactor()
+        : epoll_(epoll_create1(EPOLL_CLOEXEC)),
+          wakeup_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+          multi_(curl_multi_init())
+    {
+        if (epoll_ < 0 || wakeup_ < 0 || multi_ == nullptr)
+        {
+            return;
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = wakeup_;
+        (void)epoll_ctl(epoll_, EPOLL_CTL_ADD, wakeup_, &event);
+        // NOLINTBEGIN[cppcoreguidelines-pro-type-vararg]
+        (void)curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, onSocket);
+        (void)curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+        (void)curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, onTimer);
+        (void)curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+        // NOLINTEND[cppcoreguidelines-pro-type-vararg]
+    }
+
+    ~Reactor()
+    {
+        if (multi_ != nullptr)
+        {
+            (void)curl_multi_cleanup(multi_);
+        }
+        if (wakeup_ >= 0)
+        {
+            (void)close(wakeup_);
+        }
+        if (epoll_ >= 0)
+        {
+            (void)close(epoll_);
+        }
+    }
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+    Reactor(Reactor&&) = delete;
+    Reactor& operator=(Reactor&&) = delete;
+
+    [[nodiscard]] bool ok() const
+    {
+        return epoll_ >= 0 && wakeup_ >= 0 && multi_ != nullptr;
+    }
+
+    // Transfer feed.url into feed.body, conditional on feed.state
+    auto fetch(Feed& feed)
+    {
+        struct Awaiter
+        {
+            Reactor& reactor;
+            Feed& feed;
+
+            [[nodiscard]] bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                reactor.post([this, handle] { reactor.start(feed, handle); });
+            }
+            [[nodiscard]] FetchResult await_resume() const noexcept
+            {
+                return feed.result;
+            }
+        };
+        return Awaiter{*this, feed};
+    }
+
+    // Resume at time
+    auto sleepUntil(Clock::time_point time)
+    {
+        struct Awaiter
+        {
+            Reactor& reactor;
+            Clock::time_point time;
+
+            [[nodiscard]] bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                reactor.post([this, handle]
+                             { reactor.timers_.push(Timer{time, handle}); });
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, time};
+    }
+
+    void started() { ++live_; }
+
+    // A feed coroutine ended; run() returns after the last one
+    void finished()
+    {
+        --live_;
+        wake();
+    }
+
+    void run()
+    {
+        std::vector<epoll_event> events(maxEvents);
+        while (live_ > 0)
+        {
+            const int ready = epoll_wait(epoll_, events.data(), maxEvents, timeout());
+            if (ready < 0 && errno != EINTR)
+            {
+                std::cerr << "Failed to wait for events.\n";
+                return;
+            }
+            int running = 0;
+            for (int i = 0; i < ready; ++i)
+            {
+                const epoll_event& event = events[static_cast<std::size_t>(i)];
+                if (event.data.fd == wakeup_)
+                {
+                    std::uint64_t count = 0;
+                    (void)read(wakeup_, &count, sizeof(count));
+                    continue;
+                }
+                int flags = 0;
+                if ((event.events & EPOLLIN) != 0U)
+                {
+                    flags |= CURL_CSELECT_IN;
+                }
+                if ((event.events & EPOLLOUT) != 0U)
+                {
+                    flags |= CURL_CSELECT_OUT;
+                }
+                if ((event.events & (EPOLLERR | EPOLLHUP)) != 0U)
+                {
+                    flags |= CURL_CSELECT_ERR;
+                }
+                (void)curl_multi_socket_action(
+                    multi_, event.data.fd, flags, &running);
+            }
+            if (curlDeadline_ && Clock::now() >= *curlDeadline_)
+            {
+                curlDeadline_.reset();
+                (void)curl_multi_socket_action(
+                    multi_, CURL_SOCKET_TIMEOUT, 0, &running);
+            }
+            completeTransfers();
+            runPosted();
+            while (!timers_.empty() && timers_.top().time <= Clock::now())
+            {
+                const std::coroutine_handle<> handle = timers_.top().handle;
+                timers_.pop();
+                handle.resume();
+            }
+        }
+    }
+
+  private:
+    struct Timer
+    {
+        Clock::time_point time;
+        std::coroutine_handle<> handle;
+
+        bool operator>(const Timer& other) const { return time > other.time; }
+    };
+
+    // Run work on the reactor thread
+    void post(std::function<void()> work)
+    {
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            posted_.push_back(std::move(work));
+        }
+        wake();
+    }
+
+    void wake() const
+    {
+        const std::uint64_t one = 1;
+        (void)write(wakeup_, &one, sizeof(one));
+    }
+
+    void runPosted()
+    {
+        std::vector<std::function<void()>> work;
+        {
+            const std::lock_guard<std::mutex> lock(mutex_);
+            work.swap(posted_);
+        }
+        for (const std::function<void()>& item : work)
+        {
+            item();
+        }
+    }
+
+    // Milliseconds until the next curl or coroutine timer, -1 for none
+    [[nodiscard]] int timeout() const
+    {
+        std::optional<Clock::time_point> next = curlDeadline_;
+        if (!timers_.empty() && (!next || timers_.top().time < *next))
+        {
+            next = timers_.top().time;
+        }
+        if (!next)
+        {
+            return -1;
+        }
+        const auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+            *next - Clock::now());
+        return static_cast<int>(std::max<std::chrono::milliseconds::rep>(
+            wait.count(), 0));
+    }
+
+    void start(Feed& feed, std::coroutine_handle<> handle)
+    {
+        feed.waiting = handle;
+        feed.body.clear();
+        feed.received = PollState();
+        feed.easy = curl_easy_init();
+        if (feed.easy == nullptr)
+        {
+            feed.result = FetchResult::Failed;
+            handle.resume();
+            return;
+        }
+        if (!feed.state.etag.empty())
+        {
+            feed.headers = curl_slist_append(
+                feed.headers, ("If-None-Match: " + feed.state.etag).c_str());
+        }
+        if (!feed.state.lastModified.empty())
+        {
+            feed.headers = curl_slist_append(
+                feed.headers,
+                ("If-Modified-Since: " + feed.state.lastModified).c_str());
+        }
+        // NOLINTBEGIN[cppcoreguidelines-pro-type-vararg]
+        (void)curl_easy_setopt(feed.easy, CURLOPT_URL, feed.url.c_str());
+        (void)curl_easy_setopt(feed.easy, CURLOPT_HTTPHEADER, feed.headers);
+        (void)curl_easy_setopt(feed.easy, CURLOPT_FOLLOWLOCATION, 1L);
+        (void)curl_easy_setopt(feed.easy, CURLOPT_FAILONERROR, 1L);
+        (void)curl_easy_setopt(feed.easy, CURLOPT_WRITEFUNCTION, onBody);
+        (void)curl_easy_setopt(feed.easy, CURLOPT_WRITEDATA, &feed);
+        (void)curl_easy_setopt(feed.easy, CURLOPT_HEADERFUNCTION, onHeader);
+        (void)curl_easy_setopt(feed.easy, CURLOPT_HEADERDATA, &feed);
+        (void)curl_easy_setopt(feed.easy, CURLOPT_PRIVATE, &feed);
+        // NOLINTEND[cppcoreguidelines-pro-type-vararg]
+        (void)curl_multi_add_handle(multi_, feed.easy);
+    }
+
+    // Resume the feeds whose transfer ended
+    void completeTransfers()
+    {
+        int queued = 0;
+        while (CURLMsg* message = curl_multi_info_read(multi_, &queued))
+        {
+            if (message->msg != CURLMSG_DONE)
+            {
+                continue;
+            }
+            CURL* easy = message->easy_handle;
+            const CURLcode code = message->data.result;
+            Feed* feed = nullptr;
+            long status = 0;
+            // NOLINTBEGIN[cppcoreguidelines-pro-type-vararg]
+            (void)curl_easy_getinfo(easy, CURLINFO_PRIVATE, &feed);
+            (void)curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+            // NOLINTEND[cppcoreguidelines-pro-type-vararg]
+            (void)curl_multi_remove_handle(multi_, easy);
+            curl_easy_cleanup(easy);
+            curl_slist_free_all(feed->headers);
+            feed->easy = nullptr;
+            feed->headers = nullptr;
+
+            constexpr long notModified = 304;
+            if (code != CURLE_OK)
+            {
+                std::cerr << "Fetch of " << feed->url
+                          << " failed: " << curl_easy_strerror(code) << '\n';
+                feed->result = FetchResult::Failed;
+            }
+            else
+            {
+                feed->result = status == notModified ? FetchResult::NotModified
+                                                     : FetchResult::Body;
+            }
+            feed->waiting.resume();
+        }
+    }
+
+    static int onSocket(CURL* /*easy*/,
+                        curl_socket_t fd,
+                        int what,
+                        void* user,
+                        void* /*socketp*/)
+    {
+        auto* reactor = static_cast<Reactor*>(user);
+        if (what == CURL_POLL_REMOVE)
+        {
+            (void)epoll_ctl(reactor->epoll_, EPOLL_CTL_DEL, fd, nullptr);
+            return 0;
+        }
+        epoll_event event{};
+        if ((what & CURL_POLL_IN) != 0)
+        {
+            event.events |= EPOLLIN;
+        }
+        if ((what & CURL_POLL_OUT) != 0)
+        {
+            event.events |= EPOLLOUT;
+        }
+        event.data.fd = fd;
+        if (epoll_ctl(reactor->epoll_, EPOLL_CTL_MOD, fd, &event) != 0 &&
+            errno == ENOENT)
+        {
+            (void)epoll_ctl(reactor->epoll_, EPOLL_CTL_ADD, fd, &event);
+        }
+        return 0;
+    }
+
+    static int onTimer(CURLM* /*multi*/, long timeoutMs, void* user)
+    {
+        auto* reactor = static_cast<Reactor*>(user);
+        if (timeoutMs < 0)
+        {
+            reactor->curlDeadline_.reset();
+        }
+        else
+        {
+            reactor->curlDeadline_ =
+                Clock::now() + std::chrono::milliseconds(timeoutMs);
+        }
+        return 0;
+    }
+
+    int epoll_;
+    int wakeup_;
+    CURLM* multi_;
+    std::optional<Clock::time_point> curlDeadline_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers_;
+    std::mutex mutex_;
+    std::vector<std::function<void()>> posted_;
+    std::atomic<unsigned int> live_ = 0;
+};
+
+static FeedTask
+runFeed(Feed& feed, Reactor& reactor, TaskPool& pool, bool once)
+{
+    for (;;)
+    {
+        const Clock::time_point due = Clock::now() + feed.interval;
+        const FetchResult result = co_await reactor.fetch(feed);
+        feed.failed = result == FetchResult::Failed;
+        if (result == FetchResult::Body)
+        {
+            // Parse: inflate and parse a slice per turn on the pool
+            co_await pool.schedule();
+            std::ostringstream out;
+            std::string text; // raw feeds
+            Inflater inflater;
+            IncrementalDocument doc(feed.engine, out);
+            PublicationKey key;
+            doc.setHeaderCheck(
+                [&key, &feed](const PublicationKey& header)
+                {
+                    key = header;
+                    return header.empty() ||
+                           header.publicationTime != feed.state.publicationTime;
+                });
+            bool bad = false;
+            for (std::size_t pos = 0;
+                 pos < feed.body.size() && !bad && !doc.skipped();
+                 pos += sliceSize)
+            {
+                bad = !inflater.write(
+                    std::string_view(feed.body).substr(pos, sliceSize),
+                    [&feed, &text, &doc](std::string_view chunk)
+                    {
+                        if (feed.raw)
+                        {
+                            text += chunk;
+                        }
+                        else
+                        {
+                            doc.feed(chunk);
+                        }
+                    });
+                co_await pool.schedule();
+            }
+            if (feed.raw)
+            {
+                (void)scanPublicationKey(
+                    std::string_view(text).substr(0, publicationHeadSize), key);
+            }
+            const bool duplicate =
+                feed.raw ? !key.empty() &&
+                               key.publicationTime == feed.state.publicationTime
+                         : doc.skipped();
+
+            // Sink
+            feed.failed = bad;
+            if (bad)
+            {
+                std::cerr << "Fetch of " << feed.url
+                          << " failed: bad gzip data\n";
+            }
+            else if (duplicate)
+            {
+                std::cerr << "Skipped already processed publication "
+                          << key.publicationTime << " of " << feed.name
+                          << ".\n";
+            }
+            else
+            {
+                if (!feed.raw)
+                {
+                    doc.finish();
+                }
+                std::ofstream file(feed.output, std::ios::app);
+                if (feed.raw)
+                {
+                    file << text;
+                }
+                else
+                {
+                    file << out.view();
+                }
+                if (!file.flush())
+                {
+                    std::cerr << "Failed to write " << feed.output << ".\n";
+                    feed.failed = true;
+                }
+            }
+            // A publication that was not written must be fetched again
+            if (!feed.failed)
+            {
+                feed.state.etag = feed.received.etag;
+                feed.state.lastModified = feed.received.lastModified;
+                feed.state.publicationTime = key.publicationTime;
+                if (!feed.statePath.empty() && !feed.state.save(feed.statePath))
+                {
+                    std::cerr << "Failed to write " << feed.statePath << ".\n";
+                }
+            }
+            feed.body.clear();
+            feed.body.shrink_to_fit();
+        }
+        if (once)
+        {
+            break;
+        }
+        co_await reactor.sleepUntil(due);
+    }
+    reactor.finished();
+}
+
+// Config lines: name kind interval url output; # starts a comment line
+static bool readConfig(const std::string& path,
+                       std::vector<std::unique_ptr<Feed>>& feeds)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name) || name.front() == '#')
+        {
+            continue;
+        }
+        auto feed = std::make_unique<Feed>();
+        feed->name = name;
+        std::string kind;
+        long interval = 0;
+        if (!(fields >> kind >> interval >> feed->url >> feed->output) ||
+            interval <= 0 || (kind != "measurements" && kind != "raw"))
+        {
+            std::cerr << "Bad feed line: " << line << '\n';
+            return false;
+        }
+        feed->raw = kind == "raw";
+        feed->interval = std::chrono::seconds(interval);
+        feeds.push_back(std::move(feed));
+    }
+    return !feeds.empty();
+}
+
+struct Options
+{
+    std::string config;
+    std::string stateDir;
+    std::string sitesFile;
+    unsigned int threads = 2;
+    bool once = false;
+    bool memo = false;
+};
+
+constexpr unsigned long maxThreads = 64;
+
+static bool parseOptions(int argc, char* argv[], Options& opts)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+        {
+            char* end = nullptr;
+            const unsigned int decimal = 10;
+            const unsigned long count = std::strtoul(argv[++i], &end, decimal);
+            if (*end != '\0' || count == 0 || count > maxThreads)
+            {
+                return false;
+            }
+            opts.threads = static_cast<unsigned int>(count);
+        }
+        else if (arg == "--state-dir" && i + 1 < argc)
+        {
+            opts.stateDir = argv[++i];
+        }
+        else if (arg == "--sites" && i + 1 < argc)
+        {
+            opts.sitesFile = argv[++i];
+        }
+        else if (arg == "--once")
+        {
+            opts.once = true;
+        }
+        else if (arg == "--memo")
+        {
+            opts.memo = true;
+        }
+        else if (arg.starts_with("--") || !opts.config.empty())
+        {
+            return false;
+        }
+        else
+        {
+            opts.config = arg;
+        }
+    }
+    return !opts.config.empty();
+}
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    if (!parseOptions(argc, argv, opts))
+    {
+        std::cerr << "Usage: xmlingest [--threads N] [--once] [--memo] "
+                     "[--sites FILE] [--state-dir DIR] CONFIG\n";
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<Feed>> feeds;
+    if (!readConfig(opts.config, feeds))
+    {
+        std::cerr << "Failed to read " << opts.config << ".\n";
+        return 1;
+    }
+    SiteFilter sites;
+    if (!opts.sitesFile.empty() && !sites.load(opts.sitesFile))
+    {
+        std::cerr << "Failed to read " << opts.sitesFile << ".\n";
+        return 1;
+    }
+
+    xmlInitParser();
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+    {
+        std::cerr << "Failed to initialise libcurl.\n";
+        return 1;
+    }
+
+    int status = 0;
+    {
+        Reactor reactor;
+        if (!reactor.ok())
+        {
+            std::cerr << "Failed to create the event loop.\n";
+            status = 1;
+        }
+        else
+        {
+            // Destroyed first: joins the workers before the reactor goes
+            TaskPool pool(opts.threads);
+            for (const std::unique_ptr<Feed>& feed : feeds)
+            {
+                if (!opts.stateDir.empty())
+                {
+                    feed->statePath = opts.stateDir + '/' + feed->name + ".state";
+                    (void)feed->state.load(feed->statePath);
+                }
+                feed->engine.memo = opts.memo ? &feed->memo : nullptr;
+                feed->engine.state.filter =
+                    opts.sitesFile.empty() ? nullptr : &sites;
+                reactor.started();
+            }
+            for (const std::unique_ptr<Feed>& feed : feeds)
+            {
+                (void)runFeed(*feed, reactor, pool, opts.once);
+            }
+            reactor.run();
+        }
+        for (const std::unique_ptr<Feed>& feed : feeds)
+        {
+            status = feed->failed ? 1 : status;
+        }
+    }
+
+    curl_global_cleanup();
+    xmlCleanupParser();
+    return status;
+}
@@ -0,0 +1,88 @@
+#include "feedparser.hpp"
+#include "mapmatch.hpp"
+
+#include <iostream>
+#include <libxml/parser.h>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+
+// Match the sites of a measurement site table on stdin to road segments
+// and update the match cache xmline --match reads. Sites whose version is
+// already cached are not matched again, so a daily site table only costs
+// the sites that changed.
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: xmlmatch SEGMENTS CACHE < SITETABLE\n";
+        return 1;
+    }
+    const std::string cachePath = argv[2];
+
+    RoadGraph graph;
+    if (!graph.load(argv[1]))
+    {
+        std::cerr << "Failed to read " << argv[1] << ".\n";
+        return 1;
+    }
+    std::unordered_map<std::string, SiteMatch> cache;
+    if (access(cachePath.c_str(), F_OK) == 0 && !readMatchCache(cachePath, cache))
+    {
+        std::cerr << "Failed to read match cache " << cachePath << ".\n";
+        return 1;
+    }
+
+    xmlTextReaderPtr reader =
+        xmlReaderForFd(STDIN_FILENO, "stdin", nullptr, xmlReaderOptions());
+    if (reader == nullptr)
+    {
+        std::cerr << "Failed to create XML reader.\n";
+        return 1;
+    }
+    std::vector<SitePlacement> sites;
+    const bool read = readSitePlacements(reader, sites);
+    xmlFreeTextReader(reader);
+    xmlCleanupParser();
+    if (!read)
+    {
+        std::cerr << "Failed to read the site table.\n";
+        return 1;
+    }
+
+    std::size_t cached = 0;
+    std::size_t matched = 0;
+    std::size_t unmatched = 0;
+    for (const SitePlacement& site : sites)
+    {
+        if (site.id.empty())
+        {
+            continue;
+        }
+        const std::string version = site.version.empty() ? "-" : site.version;
+        const auto found = cache.find(site.id);
+        if (found != cache.end() && found->second.version == version)
+        {
+            ++cached;
+            continue;
+        }
+        const std::int64_t segment = site.placed ? graph.match(site.point) : -1;
+        SiteMatch& entry = cache[site.id];
+        entry.version = version;
+        entry.segment =
+            segment < 0
+                ? std::string(unmatchedSegment)
+                : graph.segment(static_cast<std::size_t>(segment)).id;
+        ++(segment < 0 ? unmatched : matched);
+    }
+
+    if (!writeMatchCache(cachePath, cache))
+    {
+        std::cerr << "Failed to write match cache " << cachePath << ".\n";
+        return 1;
+    }
+    std::cerr << "Matched " << matched << " sites, " << unmatched
+              << " without a segment, " << cached << " cached.\n";
+    return 0;
+}
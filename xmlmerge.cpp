@@ -0,0 +1,230 @@
+#include "records.hpp"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Merge binary record streams (xmline --binary) into one stream ordered by
+// (measurementTimeDefault, site key). Inputs must be runs in that order,
+// as xmline writes a single document. Every input is read through its own
+// fixed read-ahead buffer; a loser tree picks the next record with log2(k)
+// comparisons.
+
+struct Source
+{
+    int fd = -1;
+    std::string path;
+    RecordReader reader;
+    BlockRecord current;
+    bool live = false;
+    bool unsorted = false;
+
+    Source(int descriptor, std::string name, std::size_t readAhead)
+        : fd(descriptor), path(std::move(name)), reader(descriptor, readAhead)
+    {
+    }
+};
+
+// Tournament tree over k sources: node 0 holds the overall winner, every
+// inner node the loser of the match played there. Advancing the winner
+// replays only its leaf-to-root path.
+class LoserTree
+{
+  public:
+    explicit LoserTree(std::vector<Source>& sources)
+        : sources_(sources), tree_(sources.size())
+    {
+        const std::size_t k = sources_.size();
+        std::vector<std::size_t> winners(2 * k);
+        for (std::size_t i = 0; i < k; ++i)
+        {
+            winners[k + i] = i;
+        }
+        for (std::size_t node = k - 1; node >= 1; --node)
+        {
+            const std::size_t left = winners[2 * node];
+            const std::size_t right = winners[2 * node + 1];
+            const bool leftWins = beats(left, right);
+            winners[node] = leftWins ? left : right;
+            tree_[node] = leftWins ? right : left;
+        }
+        tree_[0] = k == 1 ? 0 : winners[1];
+    }
+
+    [[nodiscard]] std::size_t winner() const { return tree_[0]; }
+
+    // Replay the matches of the winner's leaf after it advanced
+    void replay()
+    {
+        std::size_t winner = tree_[0];
+        for (std::size_t node = (sources_.size() + winner) / 2; node >= 1;
+             node /= 2)
+        {
+            if (beats(tree_[node], winner))
+            {
+                std::swap(tree_[node], winner);
+            }
+        }
+        tree_[0] = winner;
+    }
+
+  private:
+    // Exhausted sources lose; ties go to the earlier input
+    [[nodiscard]] bool beats(std::size_t a, std::size_t b) const
+    {
+        const Source& lhs = sources_[a];
+        const Source& rhs = sources_[b];
+        if (!lhs.live || !rhs.live)
+        {
+            return lhs.live || (!rhs.live && a < b);
+        }
+        if (lhs.current.time != rhs.current.time)
+        {
+            return lhs.current.time < rhs.current.time;
+        }
+        if (lhs.current.site != rhs.current.site)
+        {
+            return lhs.current.site < rhs.current.site;
+        }
+        return a < b;
+    }
+
+    std::vector<Source>& sources_;
+    std::vector<std::size_t> tree_;
+};
+
+static void writeText(std::ostream& out, const BlockRecord& record)
+{
+    const std::string time = formatIsoTime(record.time);
+    std::string site = record.siteId();
+    if (site.empty())
+    {
+        site = "(unknown_site)";
+    }
+    unsigned int idx = 1;
+    for (const Measurement& pair : record.pairs)
+    {
+        out << time << ' ' << idx++ << ' ' << site << ' ' << std::defaultfloat
+            << pair.speed << ' ' << pair.flow << '\n';
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    bool text = false;
+    std::size_t readAhead = 1024 * 1024;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--text")
+        {
+            text = true;
+        }
+        else if (arg == "--read-ahead" && i + 1 < argc)
+        {
+            char* end = nullptr;
+            const int decimal = 10;
+            const unsigned long kb = std::strtoul(argv[++i], &end, decimal);
+            const unsigned long maxKb = 1UL << 20U;
+            if (*end != '\0' || kb == 0 || kb > maxKb)
+            {
+                paths.clear();
+                break;
+            }
+            readAhead = kb * 1024;
+        }
+        else
+        {
+            paths.emplace_back(arg);
+        }
+    }
+    if (paths.empty())
+    {
+        std::cerr << "Usage: xmlmerge [--text] [--read-ahead KB] FILE...\n";
+        return 1;
+    }
+
+    std::vector<Source> sources;
+    sources.reserve(paths.size());
+    int status = 0;
+    for (const std::string& path : paths)
+    {
+        // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+        const int fd = path == "-" ? fileno(stdin)
+                                   : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            std::cerr << "Failed to open " << path << ".\n";
+            status = 1;
+            continue;
+        }
+        sources.emplace_back(fd, path, readAhead);
+        Source& source = sources.back();
+        if (!source.reader.open())
+        {
+            std::cerr << path << " is not a record stream.\n";
+            status = 1;
+            continue;
+        }
+        source.live = source.reader.next(source.current);
+    }
+    if (sources.empty())
+    {
+        return 1;
+    }
+
+    if (!text)
+    {
+        std::cout << recordMagic;
+    }
+    LoserTree tree(sources);
+    while (sources[tree.winner()].live)
+    {
+        Source& source = sources[tree.winner()];
+        if (text)
+        {
+            writeText(std::cout, source.current);
+        }
+        else
+        {
+            writeBlockRecord(std::cout, source.current);
+        }
+        const std::int64_t time = source.current.time;
+        const SiteKey site = source.current.site;
+        source.live = source.reader.next(source.current);
+        if (source.live && (source.current.time < time ||
+                            (source.current.time == time &&
+                             source.current.site < site)))
+        {
+            source.unsorted = true;
+        }
+        tree.replay();
+    }
+
+    for (Source& source : sources)
+    {
+        if (source.unsorted)
+        {
+            std::cerr << source.path << " is not sorted; output is out of "
+                                        "order.\n";
+            status = 1;
+        }
+        if (source.reader.truncated())
+        {
+            std::cerr << source.path << " ends in a truncated record.\n";
+            status = 1;
+        }
+        if (source.fd != fileno(stdin))
+        {
+            (void)close(source.fd);
+        }
+    }
+    std::cout.flush();
+    return std::cout ? status : 1;
+}
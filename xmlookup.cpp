@@ -0,0 +1,123 @@
+#include "feedparser.hpp"
+#include "packformat.hpp"
+#include "siteindex.hpp"
+#include "sitefilter.hpp"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <libxml/parser.h>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+// Print the measurements of one site from feed files that have a sidecar
+// index (xmline --index): only the indexed blocks are read and parsed.
+// Packed feeds (xmlpack) have no index and are replayed whole.
+
+// Look the site up in a packed feed
+static bool lookupPacked(const std::string& feed,
+                         std::string_view doc,
+                         std::string_view site)
+{
+    SiteFilter filter;
+    filter.add(site);
+    ParserState state;
+    state.filter = &filter;
+    std::ostringstream out;
+    state.out = &out;
+    bool found = false;
+    if (!replayPacked(doc,
+                      state,
+                      [&out, &found](const ParserState& block)
+                      {
+                          if (!block.skipBlock)
+                          {
+                              emitBlock(out, block);
+                              found = true;
+                          }
+                          return true;
+                      }))
+    {
+        std::cerr << "Failed to read " << feed << ".\n";
+        return false;
+    }
+    // As with an index, a feed without the site prints nothing
+    if (found)
+    {
+        std::cout << out.view();
+    }
+    return true;
+}
+
+// Look the site up in one feed; false when the feed or index is unusable
+static bool lookupFeed(const std::string& feed,
+                       std::string_view site,
+                       FragmentParser& parser)
+{
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+    const int fd = open(feed.c_str(), O_RDONLY | O_CLOEXEC);
+    InputBuffer input;
+    const bool loaded = fd >= 0 && input.load(fd);
+    if (fd >= 0)
+    {
+        (void)close(fd);
+    }
+    if (loaded && isPacked(input.view()))
+    {
+        return lookupPacked(feed, input.view(), site);
+    }
+
+    SiteIndex index;
+    if (!index.open(siteIndexPath(feed)))
+    {
+        std::cerr << "No usable index for " << feed << ".\n";
+        return false;
+    }
+    if (!loaded || input.view().size() != index.feedSize())
+    {
+        std::cerr << "Index of " << feed << " does not match the file.\n";
+        return false;
+    }
+
+    const std::vector<BlockSpan> spans = index.find(site);
+    if (spans.empty())
+    {
+        return true;
+    }
+
+    std::cout << index.publicationTime() << '\n';
+    ParserState state;
+    for (const BlockSpan& span : spans)
+    {
+        state.resetBlock();
+        (void)parser.parse(
+            input.view().substr(span.begin, span.end - span.begin), state);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: xmlookup SITE FILE...\n";
+        return 1;
+    }
+
+    xmlInitParser();
+    const std::string_view site = argv[1];
+    FragmentParser parser;
+    int status = 0;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (!lookupFeed(argv[i], site, parser))
+        {
+            status = 1;
+        }
+    }
+    std::cout.flush();
+    xmlCleanupParser();
+    return status;
+}
@@ -0,0 +1,122 @@
+#include "feedparser.hpp"
+#include "packformat.hpp"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <libxml/parser.h>
+#include <libxml/xmlreader.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+// Convert XML feeds to the packed replay format and back.
+
+// Keep blank text nodes: the packed form must not lose any content
+static inline int packReaderOptions()
+{
+    constexpr unsigned int optsUnsigned =
+        static_cast<unsigned int>(XML_PARSE_NOERROR) |
+        static_cast<unsigned int>(XML_PARSE_NOWARNING);
+    return static_cast<int>(optsUnsigned);
+}
+
+static bool encode(int fd, const std::string& name, std::ostream& out)
+{
+    xmlTextReaderPtr reader =
+        xmlReaderForFd(fd, name.c_str(), nullptr, packReaderOptions());
+    if (reader == nullptr)
+    {
+        std::cerr << "Failed to create XML reader.\n";
+        return false;
+    }
+    const bool ok = packDocument(reader, out);
+    xmlFreeTextReader(reader);
+    if (!ok)
+    {
+        std::cerr << "Failed to pack " << name << ".\n";
+    }
+    return ok;
+}
+
+static bool decode(int fd, const std::string& name, std::ostream& out)
+{
+    InputBuffer input;
+    if (!input.load(fd) || !isPacked(input.view()))
+    {
+        std::cerr << name << " is not a packed document.\n";
+        return false;
+    }
+    if (!unpackToXml(input.view(), out))
+    {
+        std::cerr << "Failed to unpack " << name << ".\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    bool unpack = false;
+    std::string inPath = "-";
+    std::string outPath = "-";
+    int positional = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "-d")
+        {
+            unpack = true;
+        }
+        else if (positional == 0)
+        {
+            inPath = arg;
+            ++positional;
+        }
+        else if (positional == 1)
+        {
+            outPath = arg;
+            ++positional;
+        }
+        else
+        {
+            std::cerr << "Usage: xmlpack [-d] [IN [OUT]]\n";
+            return 1;
+        }
+    }
+
+    int fd = fileno(stdin);
+    if (inPath != "-")
+    {
+        // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+        fd = open(inPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            std::cerr << "Failed to open " << inPath << ".\n";
+            return 1;
+        }
+    }
+
+    std::ofstream file;
+    if (outPath != "-")
+    {
+        file.open(outPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cerr << "Failed to create " << outPath << ".\n";
+            return 1;
+        }
+    }
+    std::ostream& out = outPath == "-" ? std::cout : file;
+
+    xmlInitParser();
+    const bool ok = unpack ? decode(fd, inPath, out) : encode(fd, inPath, out);
+    out.flush();
+    if (fd != fileno(stdin))
+    {
+        (void)close(fd);
+    }
+    xmlCleanupParser();
+    return ok && static_cast<bool>(out) ? 0 : 1;
+}
@@ -0,0 +1,272 @@
+#include "feedparser.hpp"
+#include "httpfetch.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <curl/curl.h>
+#include <iostream>
+#include <libxml/parser.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Conditional-fetch poller: fetches the feed with If-None-Match /
+// If-Modified-Since, inflates the gzip body in memory and feeds it straight
+// into the block parser, skipping publications that were already processed.
+
+// Everything one transfer needs inside the libcurl callbacks
+struct Transfer
+{
+    Inflater inflater;
+    IncrementalDocument doc;
+    std::string etag;
+    std::string lastModified;
+    std::string publicationTime;
+    bool badData = false;
+
+    Transfer(BlockEngine& engine, std::ostream& out) : doc(engine, out) {}
+};
+
+static std::size_t
+onBody(char* data, std::size_t size, std::size_t count, void* user)
+{
+    auto* transfer = static_cast<Transfer*>(user);
+    const std::size_t bytes = size * count;
+    if (!transfer->inflater.write({data, bytes},
+                                  [transfer](std::string_view chunk)
+                                  { transfer->doc.feed(chunk); }))
+    {
+        transfer->badData = true;
+        return 0;
+    }
+    // Returning short aborts the transfer of an already processed document
+    return transfer->doc.skipped() ? 0 : bytes;
+}
+
+static std::size_t
+onHeader(char* data, std::size_t size, std::size_t count, void* user)
+{
+    auto* transfer = static_cast<Transfer*>(user);
+    const std::size_t bytes = size * count;
+    const std::string_view line(data, bytes);
+    if (std::string etag = headerValue(line, "etag"); !etag.empty())
+    {
+        transfer->etag = std::move(etag);
+    }
+    if (std::string modified = headerValue(line, "last-modified");
+        !modified.empty())
+    {
+        transfer->lastModified = std::move(modified);
+    }
+    return bytes;
+}
+
+enum class PollResult
+{
+    Processed,
+    NotModified,
+    Duplicate,
+    Failed
+};
+
+static PollResult pollOnce(const std::string& url,
+                           PollState& state,
+                           BlockEngine& engine)
+{
+    CURL* curl = curl_easy_init();
+    if (curl == nullptr)
+    {
+        return PollResult::Failed;
+    }
+
+    Transfer transfer(engine, std::cout);
+    const std::string lastTime = state.publicationTime;
+    transfer.doc.setHeaderCheck(
+        [&transfer, &lastTime](const PublicationKey& key)
+        {
+            transfer.publicationTime = key.publicationTime;
+            return key.empty() || key.publicationTime != lastTime;
+        });
+
+    curl_slist* headers = nullptr;
+    if (!state.etag.empty())
+    {
+        headers = curl_slist_append(
+            headers, ("If-None-Match: " + state.etag).c_str());
+    }
+    if (!state.lastModified.empty())
+    {
+        headers = curl_slist_append(
+            headers, ("If-Modified-Since: " + state.lastModified).c_str());
+    }
+
+    // NOLINTBEGIN[cppcoreguidelines-pro-type-vararg]
+    (void)curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    (void)curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    (void)curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    (void)curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    (void)curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, onBody);
+    (void)curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer);
+    (void)curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, onHeader);
+    (void)curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer);
+    const CURLcode code = curl_easy_perform(curl);
+    long status = 0;
+    (void)curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    // NOLINTEND[cppcoreguidelines-pro-type-vararg]
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+
+    constexpr long notModified = 304;
+    if (code == CURLE_OK && status == notModified)
+    {
+        return PollResult::NotModified;
+    }
+
+    PollResult result = PollResult::Processed;
+    if (transfer.doc.skipped())
+    {
+        result = PollResult::Duplicate;
+    }
+    else if (code != CURLE_OK || transfer.badData)
+    {
+        std::cerr << "Fetch of " << url << " failed: "
+                  << (transfer.badData ? "bad gzip data"
+                                       : curl_easy_strerror(code))
+                  << '\n';
+        return PollResult::Failed;
+    }
+    else
+    {
+        transfer.doc.finish();
+        std::cout.flush();
+    }
+
+    state.etag = transfer.etag;
+    state.lastModified = transfer.lastModified;
+    state.publicationTime = transfer.publicationTime;
+    return result;
+}
+
+struct Options
+{
+    std::string url;
+    std::string stateFile;
+    long interval = 60;
+    bool once = false;
+    bool memo = false;
+    bool stats = false;
+};
+
+static bool parseOptions(int argc, char* argv[], Options& opts)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--state" && i + 1 < argc)
+        {
+            opts.stateFile = argv[++i];
+        }
+        else if (arg == "--interval" && i + 1 < argc)
+        {
+            char* end = nullptr;
+            const int decimal = 10;
+            opts.interval = std::strtol(argv[++i], &end, decimal);
+            if (*end != '\0' || opts.interval <= 0)
+            {
+                return false;
+            }
+        }
+        else if (arg == "--once")
+        {
+            opts.once = true;
+        }
+        else if (arg == "--memo")
+        {
+            opts.memo = true;
+        }
+        else if (arg == "--stats")
+        {
+            opts.stats = true;
+        }
+        else if (arg.starts_with("--") || !opts.url.empty())
+        {
+            return false;
+        }
+        else
+        {
+            opts.url = arg;
+        }
+    }
+    return !opts.url.empty();
+}
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    if (!parseOptions(argc, argv, opts))
+    {
+        std::cerr << "Usage: xmlpoll [--state FILE] [--interval SECONDS] "
+                     "[--once] [--memo] [--stats] URL\n";
+        return 1;
+    }
+
+    PollState state;
+    if (!opts.stateFile.empty())
+    {
+        (void)state.load(opts.stateFile);
+    }
+
+    xmlInitParser();
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+    {
+        std::cerr << "Failed to initialise libcurl.\n";
+        return 1;
+    }
+
+    BlockMemo memo;
+    BlockEngine engine;
+    if (opts.memo)
+    {
+        engine.memo = &memo;
+    }
+
+    int status = 0;
+    for (;;)
+    {
+        const PollResult result = pollOnce(opts.url, state, engine);
+        if (result == PollResult::Failed)
+        {
+            status = 1;
+        }
+        else
+        {
+            status = 0;
+            if (result == PollResult::Duplicate)
+            {
+                std::cerr << "Skipped already processed publication "
+                          << state.publicationTime << ".\n";
+            }
+            if (!opts.stateFile.empty() && !state.save(opts.stateFile))
+            {
+                std::cerr << "Failed to write " << opts.stateFile << ".\n";
+            }
+        }
+
+        if (opts.once)
+        {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(opts.interval));
+    }
+
+    if (opts.stats)
+    {
+        engine.stats.report(std::cerr);
+    }
+
+    curl_global_cleanup();
+    xmlCleanupParser();
+    return status;
+}
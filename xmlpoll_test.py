@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+# Runs xmlpoll --once against a local http.server stand-in for the NDW feed:
+# a gzip 200, a 304 on the second poll, a duplicate publicationTime and a
+# 404. Usage: xmlpoll_test.py FEED XMLPOLL XMLINE
+
+import gzip
+import http.server
+import os
+import subprocess
+import sys
+import tempfile
+import threading
+
+SITES = 3
+
+
+def fixture(feed):
+    """The first SITES blocks of a feed, closed like the full document."""
+    with open(feed, "rb") as f:
+        head = f.read(256 * 1024)
+    end = 0
+    for _ in range(SITES):
+        end = head.index(b"</siteMeasurements>", end) + len(b"</siteMeasurements>")
+    return head[:end] + (
+        b"</payloadPublication></d2LogicalModel></SOAP:Body></SOAP:Envelope>"
+    )
+
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+    def log_message(self, format, *args):
+        pass
+
+
+def poll(xmlpoll, url, state):
+    return subprocess.run(
+        [xmlpoll, "--once", "--state", state, url],
+        capture_output=True,
+        timeout=60,
+    )
+
+
+def check(name, condition, result):
+    if not condition:
+        sys.stderr.write(
+            "FAIL %s: exit %d\nstdout: %r\nstderr: %r\n"
+            % (name, result.returncode, result.stdout[:200], result.stderr)
+        )
+        sys.exit(1)
+    print("ok", name)
+
+
+def main():
+    feed, xmlpoll, xmline = sys.argv[1:4]
+    with tempfile.TemporaryDirectory() as root:
+        document = fixture(feed)
+        plain = os.path.join(root, "feed.xml")
+        with open(plain, "wb") as f:
+            f.write(document)
+        served = os.path.join(root, "feed.xml.gz")
+        with open(served, "wb") as f:
+            f.write(gzip.compress(document))
+        expected = subprocess.run(
+            [xmline, plain], capture_output=True, check=True
+        ).stdout
+
+        server = http.server.ThreadingHTTPServer(
+            ("127.0.0.1", 0),
+            lambda *args: Handler(*args, directory=root),
+        )
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        base = "http://127.0.0.1:%d/" % server.server_address[1]
+        state = os.path.join(root, "state")
+        try:
+            result = poll(xmlpoll, base + "feed.xml.gz", state)
+            check(
+                "gzip 200",
+                result.returncode == 0 and result.stdout == expected,
+                result,
+            )
+
+            result = poll(xmlpoll, base + "feed.xml.gz", state)
+            check(
+                "304 on the second poll",
+                result.returncode == 0 and result.stdout == b"",
+                result,
+            )
+
+            # A newer file defeats If-Modified-Since, the publication stays
+            stat = os.stat(served)
+            os.utime(served, (stat.st_atime, stat.st_mtime + 60))
+            result = poll(xmlpoll, base + "feed.xml.gz", state)
+            check(
+                "duplicate publicationTime",
+                result.returncode == 0
+                and result.stdout == b""
+                and b"Skipped already processed" in result.stderr,
+                result,
+            )
+
+            result = poll(xmlpoll, base + "missing.xml.gz", state)
+            check("404", result.returncode == 1, result)
+        finally:
+            server.shutdown()
+
+
+if __name__ == "__main__":
+    main()
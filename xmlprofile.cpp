@@ -0,0 +1,60 @@
+#include "records.hpp"
+#include "speedprofile.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+// Print reference speeds from a profile written by xmline --profile: every
+// observed slot of each site as "site slot speed observations", or with
+// --at TIME only the slot of that time.
+
+int main(int argc, char* argv[])
+{
+    int first = 1;
+    bool at = false;
+    std::uint32_t atSlot = 0;
+    if (argc > 2 && std::string_view(argv[1]) == "--at")
+    {
+        std::int64_t ms = 0;
+        if (!parseIsoTime(argv[2], ms))
+        {
+            std::cerr << "Failed to parse time " << argv[2] << ".\n";
+            return 1;
+        }
+        at = true;
+        atSlot = profileSlot(ms);
+        first = 3;
+    }
+    if (argc - first < 2)
+    {
+        std::cerr << "Usage: xmlprofile [--at TIME] PROFILE SITE...\n";
+        return 1;
+    }
+
+    SpeedProfile profile;
+    if (!profile.open(argv[first], false))
+    {
+        std::cerr << "Failed to open profile " << argv[first] << ".\n";
+        return 1;
+    }
+    for (int i = first + 1; i < argc; ++i)
+    {
+        const std::string_view site = argv[i];
+        const SiteKey key = recordSiteKey(site);
+        const std::uint32_t begin = at ? atSlot : 0;
+        const std::uint32_t end = at ? atSlot + 1 : profileSlots;
+        for (std::uint32_t slot = begin; slot < end; ++slot)
+        {
+            const float speed = profile.reference(key, slot);
+            if (!std::isnan(speed))
+            {
+                std::cout << site << ' ' << slot << ' ' << speed << ' '
+                          << profile.observations(key, slot) << '\n';
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,524 @@
+#include "feedparser.hpp"
+#include "packformat.hpp"
+#include "sitekey.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <libxml/parser.h>
+#include <numeric>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Transpose time-major feed archives (one file per publication, all sites)
+// into site-major files (one file per site, all publications in time
+// order). Feeds are parsed in parallel; every worker scatters records into
+// per-site column buffers keyed by SiteKey and spills them as key-sorted runs
+// when its share of the memory budget is used up. The runs are then merged
+// site by site. Packed feeds (xmlpack) are replayed instead of parsed.
+
+struct Publication
+{
+    std::string path;
+    std::string time;
+};
+
+// Measurements of one site, one column per field
+struct SiteColumns
+{
+    std::vector<std::uint32_t> publication; // rank in time order
+    std::vector<std::uint32_t> index;       // pair number within the block
+    std::vector<double> speed;
+    std::vector<std::int64_t> flow;
+
+    [[nodiscard]] std::size_t size() const { return publication.size(); }
+
+    void append(const SiteColumns& other)
+    {
+        publication.insert(publication.end(),
+                           other.publication.begin(),
+                           other.publication.end());
+        index.insert(index.end(), other.index.begin(), other.index.end());
+        speed.insert(speed.end(), other.speed.begin(), other.speed.end());
+        flow.insert(flow.end(), other.flow.begin(), other.flow.end());
+    }
+};
+
+constexpr std::size_t recordBytes = 2 * sizeof(std::uint32_t) +
+                                    sizeof(double) + sizeof(std::int64_t);
+
+template <typename T>
+static void writeColumn(std::ostream& out, const std::vector<T>& column)
+{
+    // NOLINTBEGIN[cppcoreguidelines-pro-type-reinterpret-cast]
+    out.write(reinterpret_cast<const char*>(column.data()),
+              static_cast<std::streamsize>(column.size() * sizeof(T)));
+    // NOLINTEND[cppcoreguidelines-pro-type-reinterpret-cast]
+}
+
+template <typename T>
+static bool readColumn(std::istream& in, std::vector<T>& column, std::size_t n)
+{
+    column.resize(n);
+    // NOLINTBEGIN[cppcoreguidelines-pro-type-reinterpret-cast]
+    in.read(reinterpret_cast<char*>(column.data()),
+            static_cast<std::streamsize>(n * sizeof(T)));
+    // NOLINTEND[cppcoreguidelines-pro-type-reinterpret-cast]
+    return static_cast<bool>(in);
+}
+
+template <typename T> static bool readValue(std::istream& in, T& value)
+{
+    // NOLINTBEGIN[cppcoreguidelines-pro-type-reinterpret-cast]
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    // NOLINTEND[cppcoreguidelines-pro-type-reinterpret-cast]
+    return static_cast<bool>(in);
+}
+
+template <typename T> static void writeValue(std::ostream& out, T value)
+{
+    // NOLINTBEGIN[cppcoreguidelines-pro-type-reinterpret-cast]
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    // NOLINTEND[cppcoreguidelines-pro-type-reinterpret-cast]
+}
+
+// Per-worker scatter buffer. A run file holds sites in key order, each as
+// u64 site key, u32 record count and the four columns.
+class Scatter
+{
+  public:
+    Scatter(std::string spillPrefix, std::size_t budget)
+        : spillPrefix_(std::move(spillPrefix)), budget_(budget)
+    {
+    }
+
+    bool add(SiteKey site,
+             std::uint32_t publication,
+             const std::vector<Measurement>& pairs)
+    {
+        SiteColumns& columns = sites_[site];
+        std::uint32_t idx = 1;
+        for (const Measurement& pair : pairs)
+        {
+            columns.publication.push_back(publication);
+            columns.index.push_back(idx++);
+            columns.speed.push_back(pair.speed);
+            columns.flow.push_back(pair.flow);
+        }
+        bytes_ += pairs.size() * recordBytes;
+        return bytes_ < budget_ || spill();
+    }
+
+    // Write the buffered sites as one sorted run and start over
+    bool spill()
+    {
+        if (sites_.empty())
+        {
+            return true;
+        }
+        std::vector<const std::pair<const SiteKey, SiteColumns>*> order;
+        order.reserve(sites_.size());
+        for (const auto& site : sites_)
+        {
+            order.push_back(&site);
+        }
+        std::sort(order.begin(),
+                  order.end(),
+                  [](const auto* lhs, const auto* rhs)
+                  { return lhs->first < rhs->first; });
+
+        std::string path = spillPrefix_ + std::to_string(runs_.size()) + ".run";
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        for (const auto* site : order)
+        {
+            const SiteColumns& columns = site->second;
+            writeValue(out, site->first);
+            writeValue(out, static_cast<std::uint32_t>(columns.size()));
+            writeColumn(out, columns.publication);
+            writeColumn(out, columns.index);
+            writeColumn(out, columns.speed);
+            writeColumn(out, columns.flow);
+        }
+        if (!out.flush())
+        {
+            std::cerr << "Failed to write " << path << ".\n";
+            return false;
+        }
+        runs_.push_back(std::move(path));
+        sites_.clear();
+        bytes_ = 0;
+        return true;
+    }
+
+    [[nodiscard]] const std::vector<std::string>& runs() const
+    {
+        return runs_;
+    }
+
+  private:
+    std::string spillPrefix_;
+    std::size_t budget_;
+    std::size_t bytes_ = 0;
+    std::unordered_map<SiteKey, SiteColumns> sites_;
+    std::vector<std::string> runs_;
+};
+
+// Sequential reader of one run, positioned on its current site
+class RunReader
+{
+  public:
+    explicit RunReader(const std::string& path)
+        : in_(path, std::ios::binary)
+    {
+    }
+
+    // Load the next site; false at the end of the run or on a short read
+    bool next()
+    {
+        std::uint32_t count = 0;
+        return readValue(in_, site) && readValue(in_, count) &&
+               readColumn(in_, columns.publication, count) &&
+               readColumn(in_, columns.index, count) &&
+               readColumn(in_, columns.speed, count) &&
+               readColumn(in_, columns.flow, count);
+    }
+
+    SiteKey site = 0;
+    SiteColumns columns;
+
+  private:
+    std::ifstream in_;
+};
+
+// Parse one feed and scatter its blocks
+static bool scatterFeed(const std::string& path,
+                        std::uint32_t publication,
+                        FragmentParser& parser,
+                        SiteKeyTable& keys,
+                        Scatter& scatter)
+{
+    // NOLINTNEXTLINE[cppcoreguidelines-pro-type-vararg]
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open " << path << ".\n";
+        return false;
+    }
+    InputBuffer input;
+    const bool loaded = input.load(fd);
+    (void)close(fd);
+    if (!loaded)
+    {
+        std::cerr << "Failed to read " << path << ".\n";
+        return false;
+    }
+
+    const std::string_view doc = input.view();
+    ParserState state;
+    state.out = nullptr;
+    if (isPacked(doc))
+    {
+        return replayPacked(
+            doc,
+            state,
+            [publication, &keys, &scatter](const ParserState& block)
+            {
+                return scatter.add(
+                    keys.key(block.siteId), publication, block.pairs);
+            });
+    }
+    BlockSpan span;
+    std::size_t pos = 0;
+    while (findBlock(doc, pos, span))
+    {
+        state.resetBlock();
+        (void)parser.parse(doc.substr(span.begin, span.end - span.begin),
+                           state);
+        if (!scatter.add(keys.key(state.siteId), publication, state.pairs))
+        {
+            return false;
+        }
+        pos = span.end;
+    }
+    return true;
+}
+
+// Read the publicationTime of every feed and order the feeds by it
+static std::vector<Publication> orderPublications(
+    const std::vector<std::string>& files)
+{
+    std::vector<Publication> publications;
+    std::string head(publicationHeadSize, '\0');
+    for (const std::string& path : files)
+    {
+        std::ifstream in(path, std::ios::binary);
+        in.read(head.data(), static_cast<std::streamsize>(head.size()));
+        const auto got = static_cast<std::size_t>(in.gcount());
+        const std::string_view start = std::string_view(head).substr(0, got);
+        PublicationKey key;
+        if (!(isPacked(start) ? scanPackedPublicationKey(start, key)
+                              : scanPublicationKey(start, key)))
+        {
+            std::cerr << "Skipped " << path << ": no publicationTime.\n";
+            continue;
+        }
+        publications.push_back({path, key.publicationTime});
+    }
+    std::stable_sort(publications.begin(),
+                     publications.end(),
+                     [](const Publication& lhs, const Publication& rhs)
+                     { return lhs.time < rhs.time; });
+    return publications;
+}
+
+// Write one site file: records ordered by publication, then pair number
+static bool writeSite(const std::filesystem::path& outDir,
+                      const std::string& site,
+                      const SiteColumns& columns,
+                      const std::vector<Publication>& publications)
+{
+    std::vector<std::size_t> order(columns.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(),
+              order.end(),
+              [&columns](std::size_t lhs, std::size_t rhs)
+              {
+                  return std::tie(columns.publication[lhs], columns.index[lhs]) <
+                         std::tie(columns.publication[rhs], columns.index[rhs]);
+              });
+
+    std::string name = site.empty() ? "(unknown_site)" : site;
+    std::replace(name.begin(), name.end(), '/', '_');
+    std::ofstream out(outDir / (name + ".txt"), std::ios::trunc);
+    for (const std::size_t i : order)
+    {
+        out << publications[columns.publication[i]].time << ' '
+            << columns.index[i] << ' ' << std::defaultfloat << columns.speed[i]
+            << ' ' << columns.flow[i] << '\n';
+    }
+    return static_cast<bool>(out.flush());
+}
+
+// K-way merge of the key-sorted runs into one file per site
+static bool mergeRuns(const std::vector<std::string>& runs,
+                      const SiteKeyTable& keys,
+                      const std::filesystem::path& outDir,
+                      const std::vector<Publication>& publications,
+                      std::size_t& siteCount)
+{
+    std::vector<RunReader> readers;
+    readers.reserve(runs.size());
+    using Head = std::pair<SiteKey, std::size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<>> heads;
+    for (const std::string& run : runs)
+    {
+        readers.emplace_back(run);
+        if (readers.back().next())
+        {
+            heads.emplace(readers.back().site, readers.size() - 1);
+        }
+    }
+
+    while (!heads.empty())
+    {
+        const SiteKey site = heads.top().first;
+        SiteColumns merged;
+        while (!heads.empty() && heads.top().first == site)
+        {
+            RunReader& reader = readers[heads.top().second];
+            const std::size_t id = heads.top().second;
+            heads.pop();
+            merged.append(reader.columns);
+            if (reader.next())
+            {
+                heads.emplace(reader.site, id);
+            }
+        }
+        const std::string name = keys.name(site);
+        if (!writeSite(outDir, name, merged, publications))
+        {
+            std::cerr << "Failed to write site " << name << ".\n";
+            return false;
+        }
+        ++siteCount;
+    }
+    return true;
+}
+
+struct Options
+{
+    unsigned int threads = 1;
+    std::size_t memoryMb = 1024;
+    std::string spillDir;
+    std::string outDir;
+    std::vector<std::string> files;
+};
+
+constexpr unsigned long maxThreads = 256;
+
+static bool parseCount(const char* text, unsigned long max, unsigned long& value)
+{
+    char* end = nullptr;
+    const int decimal = 10;
+    value = std::strtoul(text, &end, decimal);
+    return *end == '\0' && value > 0 && value <= max;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& opts)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        unsigned long value = 0;
+        if (arg == "--threads" && i + 1 < argc)
+        {
+            if (!parseCount(argv[++i], maxThreads, value))
+            {
+                return false;
+            }
+            opts.threads = static_cast<unsigned int>(value);
+        }
+        else if (arg == "--memory" && i + 1 < argc)
+        {
+            const unsigned long maxMb = 1UL << 20U;
+            if (!parseCount(argv[++i], maxMb, value))
+            {
+                return false;
+            }
+            opts.memoryMb = value;
+        }
+        else if (arg == "--spill" && i + 1 < argc)
+        {
+            opts.spillDir = argv[++i];
+        }
+        else if (arg.starts_with("--"))
+        {
+            return false;
+        }
+        else if (opts.outDir.empty())
+        {
+            opts.outDir = arg;
+        }
+        else
+        {
+            opts.files.emplace_back(arg);
+        }
+    }
+    return !opts.outDir.empty() && !opts.files.empty();
+}
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    if (!parseOptions(argc, argv, opts))
+    {
+        std::cerr << "Usage: xmltranspose [--threads N] [--memory MB] "
+                     "[--spill DIR] OUTDIR FILE|DIR...\n";
+        return 1;
+    }
+    if (opts.spillDir.empty())
+    {
+        opts.spillDir = opts.outDir;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(opts.outDir, error);
+    std::filesystem::create_directories(opts.spillDir, error);
+    if (!std::filesystem::is_directory(opts.outDir) ||
+        !std::filesystem::is_directory(opts.spillDir))
+    {
+        std::cerr << "Failed to create " << opts.outDir << ".\n";
+        return 1;
+    }
+
+    const std::vector<Publication> publications =
+        orderPublications(expandInputs(opts.files));
+
+    xmlInitParser();
+    const std::size_t megabyte = 1024UL * 1024UL;
+    const std::size_t budget = opts.memoryMb * megabyte / opts.threads;
+    const std::string spillPrefix =
+        (std::filesystem::path(opts.spillDir) /
+         ("xmltranspose-" + std::to_string(getpid()) + "-"))
+            .string();
+
+    std::vector<Scatter> scatters;
+    scatters.reserve(opts.threads);
+    for (unsigned int t = 0; t < opts.threads; ++t)
+    {
+        scatters.emplace_back(spillPrefix + std::to_string(t) + "-", budget);
+    }
+
+    // Workers take feeds in time order from a shared counter
+    SiteKeyTable keys;
+    std::atomic<std::size_t> nextFeed{0};
+    std::atomic<bool> failed{false};
+    auto work = [&](Scatter& scatter)
+    {
+        FragmentParser parser;
+        for (std::size_t i = nextFeed++; i < publications.size() && !failed;
+             i = nextFeed++)
+        {
+            if (!scatterFeed(publications[i].path,
+                             static_cast<std::uint32_t>(i),
+                             parser,
+                             keys,
+                             scatter))
+            {
+                failed = true;
+            }
+        }
+        if (!scatter.spill())
+        {
+            failed = true;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < opts.threads; ++t)
+    {
+        workers.emplace_back(work, std::ref(scatters[t]));
+    }
+    work(scatters.front());
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    std::vector<std::string> runs;
+    for (const Scatter& scatter : scatters)
+    {
+        runs.insert(runs.end(), scatter.runs().begin(), scatter.runs().end());
+    }
+
+    std::size_t siteCount = 0;
+    const bool ok = !failed && mergeRuns(runs,
+                                         keys,
+                                         opts.outDir,
+                                         publications,
+                                         siteCount);
+    for (const std::string& run : runs)
+    {
+        std::filesystem::remove(run, error);
+    }
+    xmlCleanupParser();
+    if (!ok)
+    {
+        return 1;
+    }
+    std::cerr << "Transposed " << publications.size() << " publications into "
+              << siteCount << " site files (" << runs.size() << " runs).\n";
+    return 0;
+}